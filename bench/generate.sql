@@ -0,0 +1,24 @@
+-- Writes :rows ascents for COPY to standard output. Half of them are V-grades,
+-- the rest are split between Font (6A to 8A) and YDS (5.9 to 5.13d), and every
+-- scale clusters around its middle grades. Each ascent also has the V-grade
+-- for the grade(verm) column.
+SET seed = 0.42;
+
+COPY (
+    SELECT i % 10000,
+        CASE
+            WHEN scale < 0.5 THEN
+                'V' || (floor(random() * 6) + floor(random() * 6))::integer
+            WHEN scale < 0.8 THEN
+                (ARRAY['F6A', 'F6A+', 'F6B', 'F6B+', 'F6C', 'F6C+', 'F7A',
+                       'F7A+', 'F7B', 'F7B+', 'F7C', 'F7C+', 'F8A'])
+                [1 + floor(random() * 7) + floor(random() * 7)]
+            ELSE
+                (ARRAY['5.9', '5.10a', '5.10b', '5.10c', '5.10d', '5.11a',
+                       '5.11b', '5.11c', '5.11d', '5.12a', '5.12b', '5.12c',
+                       '5.12d', '5.13a', '5.13b', '5.13c', '5.13d'])
+                [1 + floor(random() * 9) + floor(random() * 9)]
+        END,
+        'V' || (floor(random() * 6) + floor(random() * 6))::integer
+    FROM (SELECT i, random() AS scale FROM generate_series(1, :rows) i) ascents
+) TO STDOUT;
@@ -0,0 +1,6 @@
+-- the grade distribution of a group of climbers
+\set climber random(0, 9899)
+SELECT grade, count(*)
+FROM ascents_:type
+WHERE climber BETWEEN :climber AND :climber + 99
+GROUP BY grade;
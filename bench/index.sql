@@ -0,0 +1,13 @@
+-- Indexes and the points table for one of the types, :ascents and :points
+-- name its tables.
+SET client_min_messages = warning;
+
+CREATE INDEX ON :ascents (grade);
+CREATE INDEX ON :ascents (climber);
+
+INSERT INTO :points
+    SELECT grade, dense_rank() OVER (ORDER BY grade)
+    FROM (SELECT DISTINCT grade FROM :ascents) grades;
+
+ANALYZE :ascents;
+ANALYZE :points;
@@ -0,0 +1,4 @@
+-- logging an ascent, checking the grade(verm) typmod on the way in
+\set climber random(0, 9999)
+\set v random(0, 10)
+INSERT INTO ascents_:type (climber, grade, verm) VALUES (:climber, 'V:v', 'V:v');
@@ -0,0 +1,6 @@
+-- a climber's score, joining their ascents with the points of each grade
+\set climber random(0, 9999)
+SELECT sum(p.points)
+FROM ascents_:type a
+JOIN points_:type p ON p.grade = a.grade
+WHERE a.climber = :climber;
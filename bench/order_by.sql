@@ -0,0 +1,3 @@
+-- a climber's ascents, hardest first
+\set climber random(0, 9999)
+SELECT grade FROM ascents_:type WHERE climber = :climber ORDER BY grade DESC;
@@ -0,0 +1,4 @@
+-- ascents within a band of grades
+\set v random(0, 9)
+\set w :v + 1
+SELECT count(*) FROM ascents_:type WHERE grade >= 'V:v' AND grade <= 'V:w';
@@ -0,0 +1,69 @@
+#!/bin/sh
+# Runs the SQL workload benchmarks against a local cluster, with pg_climb
+# installed. Each workload runs against the grade tables and against the same
+# ascents stored as text, and the results are printed as tab-separated values.
+#
+#   BENCH_DB       database to create the tables in (pg_climb_bench)
+#   BENCH_ROWS     ascents to load (1000000)
+#   BENCH_TIME     seconds to run each workload for (30)
+#   BENCH_CLIENTS  concurrent clients (4)
+#
+# The connection is taken from the usual libpq environment (PGHOST, PGPORT,
+# PGUSER). The database is dropped and created again on every run.
+set -e
+
+cd "$(dirname "$0")"
+
+DB=${BENCH_DB:-pg_climb_bench}
+ROWS=${BENCH_ROWS:-1000000}
+TIME=${BENCH_TIME:-30}
+CLIENTS=${BENCH_CLIENTS:-4}
+WORKLOADS="order_by range group_by join insert_verm"
+TYPES="grade text"
+
+PSQL="psql -X -q -v ON_ERROR_STOP=1 -d $DB"
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+dropdb --if-exists "$DB"
+createdb "$DB"
+$PSQL -f setup.sql
+
+# generate the ascents once, so both types are loaded with the same data
+$PSQL -v rows="$ROWS" -f generate.sql > "$TMP/ascents.copy"
+
+echo "load	type	ms"
+for type in $TYPES; do
+	ms=$($PSQL -c '\timing on' -c "COPY ascents_$type FROM STDIN" < "$TMP/ascents.copy" |
+		sed -n 's/^Time: \([0-9.]*\) ms.*/\1/p')
+	echo "copy	$type	$ms"
+	$PSQL -v ascents="ascents_$type" -v points="points_$type" -f index.sql
+done
+echo
+
+$PSQL -A -F "$(printf '\t')" -P footer=off -f sizes.sql
+echo
+
+echo "workload	type	tps	p50_ms	p95_ms	p99_ms"
+for workload in $WORKLOADS; do
+	for type in $TYPES; do
+		log="$TMP/$workload.$type"
+
+		tps=$(pgbench -n -f "$workload.sql" -D type="$type" \
+			-c "$CLIENTS" -j "$CLIENTS" -T "$TIME" \
+			-l --log-prefix="$log" "$DB" |
+			sed -n 's/^tps = \([0-9.]*\).*/\1/p')
+
+		# the third column of pgbench's transaction log is the latency in us
+		percentiles=$(cat "$log".* | awk '{ print $3 }' | sort -n | awk '
+			{ latency[NR] = $1 }
+			END {
+				printf "%.3f\t%.3f\t%.3f",
+					latency[int((NR - 1) * 0.50) + 1] / 1000,
+					latency[int((NR - 1) * 0.95) + 1] / 1000,
+					latency[int((NR - 1) * 0.99) + 1] / 1000
+			}')
+
+		echo "$workload	$type	$tps	$percentiles"
+	done
+done
@@ -0,0 +1,13 @@
+-- Tables for the SQL benchmarks. Every workload runs against the grade
+-- tables and against the same data stored as text, the baseline.
+SET client_min_messages = warning;
+
+CREATE EXTENSION IF NOT EXISTS pg_climb;
+
+DROP TABLE IF EXISTS ascents_grade, ascents_text, points_grade, points_text;
+
+CREATE TABLE ascents_grade(climber integer, grade grade, verm grade(verm));
+CREATE TABLE ascents_text(climber integer, grade text, verm text);
+
+CREATE TABLE points_grade(grade grade PRIMARY KEY, points integer);
+CREATE TABLE points_text(grade text PRIMARY KEY, points integer);
@@ -0,0 +1,9 @@
+-- The size of each ascents table and of its index on grade
+SELECT c.relname AS table,
+    pg_size_pretty(pg_table_size(c.oid)) AS table_size,
+    pg_size_pretty(pg_relation_size(i.indexrelid)) AS grade_index_size
+FROM pg_class c
+JOIN pg_index i ON i.indrelid = c.oid
+JOIN pg_attribute a ON a.attrelid = c.oid AND a.attnum = i.indkey[0]
+WHERE c.relname IN ('ascents_grade', 'ascents_text') AND a.attname = 'grade'
+ORDER BY c.relname;
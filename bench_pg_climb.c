@@ -0,0 +1,200 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pg_climb.h"
+
+// Every benchmark walks a pool of grades drawn from a realistic distribution,
+// the pool is small enough to stay in cache so only the code is measured
+#define POOL_SIZE	1024
+#define POOL_MASK	(POOL_SIZE - 1)
+#define DEFAULT_ITERATIONS	1000000
+
+typedef struct {
+	const char *name;
+	void (*run)(uint64_t iterations);
+} Benchmark;
+
+static char strings[POOL_SIZE][GRADE_STRING_SIZE];
+static Grade *grades[POOL_SIZE];
+static SerializedGrade *serialized[POOL_SIZE];
+
+// results are accumulated here so the compiler can't drop the work
+static volatile uint64_t sink;
+
+// count allocations through the library's allocator
+static uint64_t allocations;
+
+static void *counting_alloc(size_t size)
+{
+	allocations++;
+	return malloc(size);
+}
+
+static const GradeAllocator counting_allocator = { counting_alloc, free };
+
+// xorshift, so every run benchmarks the same inputs
+static uint32_t rng_state = 2463534242u;
+
+static uint32_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+// Ascents cluster around the middle grades of each scale. Half of them are
+// V-grades, the rest are split between Font (6A to 8A) and YDS (5.9 to 5.13d).
+static PackedGrade random_grade(void)
+{
+	uint32_t scale = rng_next() % 10;
+
+	if (scale < 5)
+		return packed_grade_make(VERMTYPE, rng_next() % 6 + rng_next() % 6);
+	else if (scale < 8)
+		return packed_grade_make(FONTTYPE, 10 + rng_next() % 7 + rng_next() % 7);
+	else
+		return packed_grade_make(YDSTYPE, 8 + rng_next() % 9 + rng_next() % 9);
+}
+
+static void build_pool(void)
+{
+	size_t size;
+	size_t len;
+
+	for (int i = 0; i < POOL_SIZE; i++) {
+		PackedGrade packed = random_grade();
+		const char *str = packed_grade_string(packed, &len);
+
+		memcpy(strings[i], str, len);
+		grades[i] = grade_from_packed(packed);
+		serialized[i] = serialized_grade_from_grade(grades[i], &size);
+	}
+}
+
+static void bench_grade_from_string(uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++) {
+		Grade *grade = grade_from_string(strings[i & POOL_MASK], ANYTYPE);
+
+		sink += grade->type;
+		grade_free(grade);
+	}
+}
+
+static void bench_packed_grade_parse(uint64_t iterations)
+{
+	PackedGrade packed;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		packed_grade_parse(strings[i & POOL_MASK], ANYTYPE, &packed);
+		sink += packed;
+	}
+}
+
+static void bench_grade_to_string(uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++) {
+		char *str = grade_to_string(grades[i & POOL_MASK]);
+
+		sink += str[0];
+		free(str);
+	}
+}
+
+static void bench_grade_cmp(uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++)
+		sink += grade_cmp(grades[i & POOL_MASK], grades[(i + 1) & POOL_MASK]);
+}
+
+static void bench_serialized_grade_cmp(uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++)
+		sink += serialized_grade_cmp(serialized[i & POOL_MASK],
+					     serialized[(i + 1) & POOL_MASK]);
+}
+
+static void bench_serialized_round_trip(uint64_t iterations)
+{
+	size_t size;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		SerializedGrade *sg = serialized_grade_from_grade(grades[i & POOL_MASK], &size);
+		Grade *grade = grade_from_serialized(sg);
+
+		sink += grade->type;
+		grade_free(grade);
+		serialized_grade_free(sg);
+	}
+}
+
+static const Benchmark benchmarks[] = {
+	{ "grade_from_string", bench_grade_from_string },
+	{ "packed_grade_parse", bench_packed_grade_parse },
+	{ "grade_to_string", bench_grade_to_string },
+	{ "grade_cmp", bench_grade_cmp },
+	{ "serialized_grade_cmp", bench_serialized_grade_cmp },
+	{ "serialized_round_trip", bench_serialized_round_trip },
+};
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+// Runs every benchmark, or only those named on the command line. The results
+// are printed as tab-separated values with a header, one benchmark per line.
+//
+// usage: bench_pg_climb [-n iterations] [benchmark...]
+int main(int argc, char **argv)
+{
+	uint64_t iterations = DEFAULT_ITERATIONS;
+	int first = 1;
+
+	if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		iterations = strtoull(argv[2], NULL, 10);
+		first = 3;
+	}
+
+	if (iterations == 0) {
+		fprintf(stderr, "iterations must be a positive number\n");
+		return 1;
+	}
+
+	build_pool();
+	grade_set_allocator(&counting_allocator);
+
+	printf("benchmark\titerations\tns_per_op\tallocs_per_op\tops_per_sec\n");
+
+	for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+		const Benchmark *bench = &benchmarks[b];
+		struct timespec start;
+		struct timespec end;
+		double ns;
+		int selected = first >= argc;
+
+		for (int i = first; i < argc; i++)
+			selected |= strcmp(argv[i], bench->name) == 0;
+
+		if (!selected)
+			continue;
+
+		// warm up the caches, and the library's lazily built tables
+		bench->run(POOL_SIZE);
+
+		allocations = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		bench->run(iterations);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ns = elapsed_ns(&start, &end);
+		printf("%s\t%" PRIu64 "\t%.2f\t%.2f\t%.0f\n", bench->name, iterations,
+		       ns / iterations, (double)allocations / iterations,
+		       iterations / (ns / 1e9));
+	}
+
+	return 0;
+}
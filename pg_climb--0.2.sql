@@ -0,0 +1,664 @@
+\echo Use "CREATE EXTENSION pg_climb" to load this file. \quit
+
+CREATE TYPE grade;
+
+-------------------------------------------------------------------
+--  GRADE TYPE (grade)
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_in(cstring)
+	RETURNS grade
+	AS 'MODULE_PATHNAME','PACKED_GRADE_in'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_out(grade)
+	RETURNS cstring
+	AS 'MODULE_PATHNAME','PACKED_GRADE_out'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_typmod_in(cstring[])
+	RETURNS integer
+	AS 'MODULE_PATHNAME', 'GRADE_typmod_in'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_typmod_out(integer)
+	RETURNS cstring
+	AS 'MODULE_PATHNAME', 'GRADE_typmod_out'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_recv(internal, oid, integer)
+	RETURNS grade
+	AS 'MODULE_PATHNAME','GRADE_recv'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_send(grade)
+	RETURNS bytea
+	AS 'MODULE_PATHNAME','GRADE_send'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+-- grades are packed into a single 32-bit word, see PackedGrade
+CREATE TYPE grade (
+	internallength = 4,
+	input = grade_in,
+	output = grade_out,
+	receive = grade_recv,
+	send = grade_send,
+	typmod_in = grade_typmod_in,
+	typmod_out = grade_typmod_out,
+	passedbyvalue,
+	alignment = int4,
+	storage = plain
+);
+
+CREATE OR REPLACE FUNCTION grade_support(internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_support'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade(grade, integer, boolean)
+	RETURNS grade
+	AS 'MODULE_PATHNAME','PACKED_GRADE_enforce_typmod'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE
+	SUPPORT grade_support;
+
+CREATE CAST (grade AS grade) WITH FUNCTION grade(grade, integer, boolean) AS IMPLICIT;
+
+-------------------------------------------------------------------
+-- BTREE indexes
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_lt(grade1 grade, grade2 grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_lt'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_le(grade1 grade, grade2 grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_le'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_gt(grade1 grade, grade2 grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_gt'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_ge(grade1 grade, grade2 grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_ge'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_eq(grade1 grade, grade2 grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_eq'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_neq(grade1 grade, grade2 grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_neq'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_cmp(grade1 grade, grade2 grade)
+	RETURNS integer
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_cmp'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_sortsupport(internal)
+	RETURNS void
+	AS 'MODULE_PATHNAME', 'GRADE_sortsupport'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+--
+-- Sorting operators for Btree
+--
+
+CREATE OPERATOR < (
+	LEFTARG = grade, RIGHTARG = grade, PROCEDURE = grade_lt,
+	COMMUTATOR = '>', NEGATOR = '>=',
+	RESTRICT = scalarltsel, JOIN = scalarltjoinsel
+);
+
+CREATE OPERATOR <= (
+	LEFTARG = grade, RIGHTARG = grade, PROCEDURE = grade_le,
+	COMMUTATOR = '>=', NEGATOR = '>',
+	RESTRICT = scalarlesel, JOIN = scalarlejoinsel
+);
+
+CREATE OPERATOR = (
+	LEFTARG = grade, RIGHTARG = grade, PROCEDURE = grade_eq,
+	COMMUTATOR = '=', NEGATOR = '<>',
+	RESTRICT = eqsel, JOIN = eqjoinsel, HASHES, MERGES
+);
+
+CREATE OPERATOR <> (
+	LEFTARG = grade, RIGHTARG = grade, PROCEDURE = grade_neq,
+	COMMUTATOR = '<>', NEGATOR = '=',
+	RESTRICT = neqsel, JOIN = neqjoinsel
+);
+
+CREATE OPERATOR >= (
+	LEFTARG = grade, RIGHTARG = grade, PROCEDURE = grade_ge,
+	COMMUTATOR = '<=', NEGATOR = '<',
+	RESTRICT = scalargesel, JOIN = scalargejoinsel
+);
+
+CREATE OPERATOR > (
+	LEFTARG = grade, RIGHTARG = grade, PROCEDURE = grade_gt,
+	COMMUTATOR = '<', NEGATOR = '<=',
+	RESTRICT = scalargtsel, JOIN = scalargtjoinsel
+);
+
+CREATE OPERATOR CLASS btree_grade_ops
+	DEFAULT FOR TYPE grade USING btree AS
+	OPERATOR	1	< ,
+	OPERATOR	2	<= ,
+	OPERATOR	3	= ,
+	OPERATOR	4	>= ,
+	OPERATOR	5	> ,
+	FUNCTION	1	grade_cmp (grade1 grade, grade2 grade),
+	FUNCTION	2	grade_sortsupport (internal);
+
+-------------------------------------------------------------------
+-- HASH indexes
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_hash(grade)
+	RETURNS integer
+	AS 'MODULE_PATHNAME', 'GRADE_hash'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_hash_extended(grade, bigint)
+	RETURNS bigint
+	AS 'MODULE_PATHNAME', 'GRADE_hash_extended'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS hash_grade_ops
+	DEFAULT FOR TYPE grade USING hash AS
+	OPERATOR	1	= ,
+	FUNCTION	1	grade_hash (grade),
+	FUNCTION	2	grade_hash_extended (grade, bigint);
+
+-------------------------------------------------------------------
+-- BRIN indexes
+-------------------------------------------------------------------
+CREATE OPERATOR CLASS brin_grade_minmax_ops
+	DEFAULT FOR TYPE grade USING brin AS
+	OPERATOR	1	< ,
+	OPERATOR	2	<= ,
+	OPERATOR	3	= ,
+	OPERATOR	4	>= ,
+	OPERATOR	5	> ,
+	FUNCTION	1	brin_minmax_opcinfo (internal),
+	FUNCTION	2	brin_minmax_add_value (internal, internal, internal, internal),
+	FUNCTION	3	brin_minmax_consistent (internal, internal, internal),
+	FUNCTION	4	brin_minmax_union (internal, internal, internal);
+
+CREATE OPERATOR CLASS brin_grade_bloom_ops
+	FOR TYPE grade USING brin AS
+	OPERATOR	1	= ,
+	FUNCTION	1	brin_bloom_opcinfo (internal),
+	FUNCTION	2	brin_bloom_add_value (internal, internal, internal, internal),
+	FUNCTION	3	brin_bloom_consistent (internal, internal, internal, integer),
+	FUNCTION	4	brin_bloom_union (internal, internal, internal),
+	FUNCTION	5	brin_bloom_options (internal),
+	FUNCTION	11	grade_hash (grade);
+
+-------------------------------------------------------------------
+-- RANGE types
+-------------------------------------------------------------------
+CREATE TYPE grade_range;
+
+CREATE OR REPLACE FUNCTION grade_range_canonical(grade_range)
+	RETURNS grade_range
+	AS 'MODULE_PATHNAME', 'GRADE_range_canonical'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_range_subdiff(grade, grade)
+	RETURNS float8
+	AS 'MODULE_PATHNAME', 'GRADE_range_subdiff'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+-- GiST and SP-GiST indexes on grade_range and grade_multirange use the
+-- built-in range_ops and multirange_ops
+CREATE TYPE grade_range AS RANGE (
+	subtype = grade,
+	subtype_opclass = btree_grade_ops,
+	canonical = grade_range_canonical,
+	subtype_diff = grade_range_subdiff,
+	multirange_type_name = grade_multirange
+);
+
+-------------------------------------------------------------------
+-- CONVERSION between scales
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_convert(grade, scale text)
+	RETURNS grade
+	AS 'MODULE_PATHNAME', 'GRADE_convert'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+-------------------------------------------------------------------
+-- ARRAYS
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_parse_array(text[], scale text DEFAULT 'any')
+	RETURNS grade[]
+	AS 'MODULE_PATHNAME', 'GRADE_parse_array'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS gin_grade_ops
+	DEFAULT FOR TYPE grade[] USING gin AS
+	OPERATOR	1	&& (anyarray, anyarray),
+	OPERATOR	2	@> (anyarray, anyarray),
+	OPERATOR	3	<@ (anyarray, anyarray),
+	OPERATOR	4	= (anyarray, anyarray),
+	FUNCTION	1	grade_cmp (grade1 grade, grade2 grade),
+	FUNCTION	2	ginarrayextract (anyarray, internal, internal),
+	FUNCTION	3	ginqueryarrayextract (anyarray, internal, int2, internal, internal, internal, internal),
+	FUNCTION	4	ginarrayconsistent (internal, int2, anyarray, int4, internal, internal, internal, internal),
+	FUNCTION	6	ginarraytriconsistent (internal, int2, anyarray, int4, internal, internal, internal),
+	STORAGE	grade;
+
+-------------------------------------------------------------------
+-- AGGREGATES
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_larger(grade, grade)
+	RETURNS grade
+	AS 'MODULE_PATHNAME', 'GRADE_larger'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_smaller(grade, grade)
+	RETURNS grade
+	AS 'MODULE_PATHNAME', 'GRADE_smaller'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+-------------------------------------------------------------------
+-- HISTOGRAMS
+-------------------------------------------------------------------
+CREATE TYPE grade_histogram;
+
+CREATE OR REPLACE FUNCTION grade_histogram_in(cstring)
+	RETURNS grade_histogram
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_in'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_out(grade_histogram)
+	RETURNS cstring
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_out'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_recv(internal)
+	RETURNS grade_histogram
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_recv'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_send(grade_histogram)
+	RETURNS bytea
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_send'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+-- only the grades that were counted are stored, see GradeHistogram
+CREATE TYPE grade_histogram (
+	internallength = variable,
+	input = grade_histogram_in,
+	output = grade_histogram_out,
+	receive = grade_histogram_recv,
+	send = grade_histogram_send,
+	alignment = int4,
+	storage = extended
+);
+
+CREATE OR REPLACE FUNCTION grade_histogram_add(grade_histogram, grade_histogram)
+	RETURNS grade_histogram
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_add'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_subtract(grade_histogram, grade_histogram)
+	RETURNS grade_histogram
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_subtract'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_count(grade_histogram, grade)
+	RETURNS bigint
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_count'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR + (
+	LEFTARG = grade_histogram, RIGHTARG = grade_histogram,
+	PROCEDURE = grade_histogram_add, COMMUTATOR = '+'
+);
+
+CREATE OPERATOR - (
+	LEFTARG = grade_histogram, RIGHTARG = grade_histogram,
+	PROCEDURE = grade_histogram_subtract
+);
+
+CREATE OPERATOR -> (
+	LEFTARG = grade_histogram, RIGHTARG = grade,
+	PROCEDURE = grade_histogram_count
+);
+
+CREATE OR REPLACE FUNCTION grade_histogram_transfn(internal, grade)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_transfn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_inv_transfn(internal, grade)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_inv_transfn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_combinefn(internal, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_combinefn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_serialfn(internal)
+	RETURNS bytea
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_serialfn'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_deserialfn(bytea, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_deserialfn'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_finalfn(internal)
+	RETURNS grade_histogram
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_finalfn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_min_final(internal)
+	RETURNS grade
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_min_final'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_histogram_max_final(internal)
+	RETURNS grade
+	AS 'MODULE_PATHNAME', 'GRADE_histogram_max_final'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+-- the state is a fixed array of counts for every grade of every scale. In a
+-- sliding window frame, grades leaving the frame are subtracted back out.
+CREATE AGGREGATE grade_histogram(grade) (
+	SFUNC = grade_histogram_transfn,
+	STYPE = internal,
+	SSPACE = 6144,
+	FINALFUNC = grade_histogram_finalfn,
+	COMBINEFUNC = grade_histogram_combinefn,
+	SERIALFUNC = grade_histogram_serialfn,
+	DESERIALFUNC = grade_histogram_deserialfn,
+	MSFUNC = grade_histogram_transfn,
+	MINVFUNC = grade_histogram_inv_transfn,
+	MSTYPE = internal,
+	MSSPACE = 6144,
+	MFINALFUNC = grade_histogram_finalfn,
+	PARALLEL = SAFE
+);
+
+-- the state is the grade itself, which is passed by value, and the sort
+-- operators let the planner answer these from a btree index. A sliding window
+-- frame counts grades instead, so the grade leaving the frame can be removed.
+CREATE AGGREGATE min(grade) (
+	SFUNC = grade_smaller,
+	STYPE = grade,
+	COMBINEFUNC = grade_smaller,
+	SORTOP = <,
+	MSFUNC = grade_histogram_transfn,
+	MINVFUNC = grade_histogram_inv_transfn,
+	MSTYPE = internal,
+	MSSPACE = 6144,
+	MFINALFUNC = grade_histogram_min_final,
+	PARALLEL = SAFE
+);
+
+CREATE AGGREGATE max(grade) (
+	SFUNC = grade_larger,
+	STYPE = grade,
+	COMBINEFUNC = grade_larger,
+	SORTOP = >,
+	MSFUNC = grade_histogram_transfn,
+	MINVFUNC = grade_histogram_inv_transfn,
+	MSTYPE = internal,
+	MSSPACE = 6144,
+	MFINALFUNC = grade_histogram_max_final,
+	PARALLEL = SAFE
+);
+
+-------------------------------------------------------------------
+-- ORDERED-SET AGGREGATES
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_percentile_disc_final(internal, float8)
+	RETURNS grade
+	AS 'MODULE_PATHNAME', 'GRADE_percentile_disc_final'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_percentile_disc_multi_final(internal, float8[])
+	RETURNS grade[]
+	AS 'MODULE_PATHNAME', 'GRADE_percentile_disc_multi_final'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_mode_final(internal)
+	RETURNS grade
+	AS 'MODULE_PATHNAME', 'GRADE_mode_final'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+-- these count grades into a histogram rather than sorting them, and take the
+-- place of the built-in aggregates of the same name for grade
+CREATE AGGREGATE percentile_disc(float8 ORDER BY grade) (
+	SFUNC = grade_histogram_transfn,
+	STYPE = internal,
+	SSPACE = 6144,
+	FINALFUNC = grade_percentile_disc_final,
+	FINALFUNC_MODIFY = READ_ONLY,
+	PARALLEL = SAFE
+);
+
+CREATE AGGREGATE percentile_disc(float8[] ORDER BY grade) (
+	SFUNC = grade_histogram_transfn,
+	STYPE = internal,
+	SSPACE = 6144,
+	FINALFUNC = grade_percentile_disc_multi_final,
+	FINALFUNC_MODIFY = READ_ONLY,
+	PARALLEL = SAFE
+);
+
+CREATE AGGREGATE mode(ORDER BY grade) (
+	SFUNC = grade_histogram_transfn,
+	STYPE = internal,
+	SSPACE = 6144,
+	FINALFUNC = grade_mode_final,
+	FINALFUNC_MODIFY = READ_ONLY,
+	PARALLEL = SAFE
+);
+
+-------------------------------------------------------------------
+-- TOP K AGGREGATES
+-------------------------------------------------------------------
+CREATE OR REPLACE FUNCTION grade_top_k_transfn(internal, grade, integer)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_top_k_transfn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_top_k_points_transfn(internal, grade, float8, integer)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_top_k_points_transfn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_top_k_combinefn(internal, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_top_k_combinefn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_top_k_serialfn(internal)
+	RETURNS bytea
+	AS 'MODULE_PATHNAME', 'GRADE_top_k_serialfn'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_top_k_deserialfn(bytea, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME', 'GRADE_top_k_deserialfn'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_top_k_finalfn(internal)
+	RETURNS grade[]
+	AS 'MODULE_PATHNAME', 'GRADE_top_k_finalfn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION grade_top_k_points_finalfn(internal)
+	RETURNS float8
+	AS 'MODULE_PATHNAME', 'GRADE_top_k_points_finalfn'
+	LANGUAGE 'c' IMMUTABLE PARALLEL SAFE;
+
+-- the k hardest grades, hardest first
+CREATE AGGREGATE grade_top_k(grade, k integer) (
+	SFUNC = grade_top_k_transfn,
+	STYPE = internal,
+	FINALFUNC = grade_top_k_finalfn,
+	COMBINEFUNC = grade_top_k_combinefn,
+	SERIALFUNC = grade_top_k_serialfn,
+	DESERIALFUNC = grade_top_k_deserialfn,
+	PARALLEL = SAFE
+);
+
+-- the total points of the k hardest ascents, ascents of the same grade are
+-- ranked by their points
+CREATE AGGREGATE grade_top_k_points(grade, points float8, k integer) (
+	SFUNC = grade_top_k_points_transfn,
+	STYPE = internal,
+	FINALFUNC = grade_top_k_points_finalfn,
+	COMBINEFUNC = grade_top_k_combinefn,
+	SERIALFUNC = grade_top_k_serialfn,
+	DESERIALFUNC = grade_top_k_deserialfn,
+	PARALLEL = SAFE
+);
+
+CREATE OR REPLACE FUNCTION GradeType(grade)
+	RETURNS text
+	AS 'MODULE_PATHNAME', 'PACKED_GRADE_type'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+-------------------------------------------------------------------
+--  LEGACY GRADE TYPE (legacy_grade)
+-------------------------------------------------------------------
+-- the variable-length grade of 0.1, which an update to 0.2 leaves existing
+-- columns as. It is defined here as the update defines it, so that a fresh
+-- install has the same objects as an updated one and a dump of an updated
+-- database restores into it.
+CREATE TYPE legacy_grade;
+
+CREATE OR REPLACE FUNCTION legacy_grade_in(cstring)
+	RETURNS legacy_grade
+	AS 'MODULE_PATHNAME','LEGACY_GRADE_in'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_out(legacy_grade)
+	RETURNS cstring
+	AS 'MODULE_PATHNAME','GRADE_out'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE legacy_grade (
+	input = legacy_grade_in,
+	output = legacy_grade_out,
+	typmod_in = grade_typmod_in,
+	typmod_out = grade_typmod_out
+);
+
+CREATE OR REPLACE FUNCTION legacy_grade(legacy_grade, integer, boolean)
+	RETURNS legacy_grade
+	AS 'MODULE_PATHNAME','GRADE_enforce_typmod'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (legacy_grade AS legacy_grade) WITH FUNCTION legacy_grade(legacy_grade, integer, boolean) AS IMPLICIT;
+
+CREATE OR REPLACE FUNCTION grade(legacy_grade)
+	RETURNS grade
+	AS 'MODULE_PATHNAME','LEGACY_GRADE_to_grade'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (legacy_grade AS grade) WITH FUNCTION grade(legacy_grade) AS ASSIGNMENT;
+
+CREATE OR REPLACE FUNCTION legacy_grade_lt(grade1 legacy_grade, grade2 legacy_grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'GRADE_lt'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_le(grade1 legacy_grade, grade2 legacy_grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'GRADE_le'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_gt(grade1 legacy_grade, grade2 legacy_grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'GRADE_gt'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_ge(grade1 legacy_grade, grade2 legacy_grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'GRADE_ge'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_eq(grade1 legacy_grade, grade2 legacy_grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'GRADE_eq'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_neq(grade1 legacy_grade, grade2 legacy_grade)
+	RETURNS bool
+	AS 'MODULE_PATHNAME', 'GRADE_neq'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_cmp(grade1 legacy_grade, grade2 legacy_grade)
+	RETURNS integer
+	AS 'MODULE_PATHNAME', 'GRADE_cmp'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION legacy_grade_sortsupport(internal)
+	RETURNS void
+	AS 'MODULE_PATHNAME', 'LEGACY_GRADE_sortsupport'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR < (
+	LEFTARG = legacy_grade, RIGHTARG = legacy_grade, PROCEDURE = legacy_grade_lt,
+	COMMUTATOR = '>', NEGATOR = '>=',
+	RESTRICT = scalarltsel, JOIN = scalarltjoinsel
+);
+
+CREATE OPERATOR <= (
+	LEFTARG = legacy_grade, RIGHTARG = legacy_grade, PROCEDURE = legacy_grade_le,
+	COMMUTATOR = '>=', NEGATOR = '>',
+	RESTRICT = scalarlesel, JOIN = scalarlejoinsel
+);
+
+CREATE OPERATOR = (
+	LEFTARG = legacy_grade, RIGHTARG = legacy_grade, PROCEDURE = legacy_grade_eq,
+	COMMUTATOR = '=', NEGATOR = '<>',
+	RESTRICT = eqsel, JOIN = eqjoinsel, HASHES, MERGES
+);
+
+CREATE OPERATOR <> (
+	LEFTARG = legacy_grade, RIGHTARG = legacy_grade, PROCEDURE = legacy_grade_neq,
+	COMMUTATOR = '<>', NEGATOR = '=',
+	RESTRICT = neqsel, JOIN = neqjoinsel
+);
+
+CREATE OPERATOR >= (
+	LEFTARG = legacy_grade, RIGHTARG = legacy_grade, PROCEDURE = legacy_grade_ge,
+	COMMUTATOR = '<=', NEGATOR = '<',
+	RESTRICT = scalargesel, JOIN = scalargejoinsel
+);
+
+CREATE OPERATOR > (
+	LEFTARG = legacy_grade, RIGHTARG = legacy_grade, PROCEDURE = legacy_grade_gt,
+	COMMUTATOR = '<', NEGATOR = '<=',
+	RESTRICT = scalargtsel, JOIN = scalargtjoinsel
+);
+
+CREATE OPERATOR CLASS btree_legacy_grade_ops
+	DEFAULT FOR TYPE legacy_grade USING btree AS
+	OPERATOR	1	< ,
+	OPERATOR	2	<= ,
+	OPERATOR	3	= ,
+	OPERATOR	4	>= ,
+	OPERATOR	5	> ,
+	FUNCTION	1	legacy_grade_cmp (grade1 legacy_grade, grade2 legacy_grade),
+	FUNCTION	2	legacy_grade_sortsupport (internal);
+
+CREATE OR REPLACE FUNCTION GradeType(legacy_grade)
+	RETURNS text
+	AS 'MODULE_PATHNAME', 'GRADE_type'
+	LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
@@ -1,13 +1,41 @@
 #include "pg_climb.h"
 
 #include <assert.h>
-#include <errno.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+static const GradeAllocator default_allocator = { malloc, free };
+static GradeAllocator allocator = { malloc, free };
+
+void grade_set_allocator(const GradeAllocator *a)
+{
+	allocator = a ? *a : default_allocator;
+}
+
+static void *climb_malloc(size_t size)
+{
+	return allocator.alloc(size);
+}
+
+static void climb_free(void *ptr)
+{
+	if (ptr)
+		allocator.free(ptr);
+}
+
+static char *climb_strdup(const char *str)
+{
+	size_t	len = strlen(str) + 1;
+	char	*dup = climb_malloc(len);
+
+	memcpy(dup, str, len);
+	return dup;
+}
+
 const char *grade_type_name(uint32_t type)
 {
 	switch (type) {
@@ -22,6 +50,26 @@ const char *grade_type_name(uint32_t type)
 	}
 }
 
+const char *grade_parse_error_message(int error)
+{
+	switch (error) {
+		case GRADE_PARSE_OK:
+			return "The grade is valid.";
+		case GRADE_PARSE_EMPTY:
+			return "The grade is empty.";
+		case GRADE_PARSE_UNKNOWN_SCALE:
+			return "Grades start with \"V\", \"F\" or \"5.\".";
+		case GRADE_PARSE_SYNTAX:
+			return "The grade is malformed for its scale.";
+		case GRADE_PARSE_OUT_OF_RANGE:
+			return "The grade is beyond the end of its scale.";
+		case GRADE_PARSE_WRONG_SCALE:
+			return "The grade is not on the expected scale.";
+		default:
+			return "Unknown error.";
+	}
+}
+
 uint32_t grade_type_from_typmod(const char *str)
 {
 	if (strcasecmp("verm", str) == 0) {
@@ -41,15 +89,15 @@ int typmod_string(char **str, int32_t typmod)
 
 	switch (typmod) {
 		case VERMTYPE:
-			*str = strdup("verm");
+			*str = climb_strdup("verm");
 			ret = 0;
 			break;
 		case FONTTYPE:
-			*str = strdup("font");
+			*str = climb_strdup("font");
 			ret = 0;
 			break;
 		case YDSTYPE:
-			*str = strdup("yds");
+			*str = climb_strdup("yds");
 			ret = 0;
 			break;
 		default:
@@ -64,8 +112,8 @@ Verm *verm_create(uint8_t initial_value)
 	Verm *verm;
 	uint8_t *value;
 
-	verm = malloc(sizeof(Verm));
-	value = malloc(sizeof(uint8_t));
+	verm = climb_malloc(sizeof(Verm));
+	value = climb_malloc(sizeof(uint8_t));
 
 	memcpy(value, &initial_value, sizeof(uint8_t));
 	verm->value = value;
@@ -76,8 +124,8 @@ Verm *verm_create(uint8_t initial_value)
 
 void verm_free(Verm *verm)
 {
-	free(verm->value);
-	free(verm);
+	climb_free(verm->value);
+	climb_free(verm);
 }
 
 int verm_cmp(const Verm *v1, const Verm *v2)
@@ -97,26 +145,17 @@ void verm_set_value(Verm *verm, uint8_t value)
 
 int verm_parse(Verm *verm, const char *str)
 {
-	int	value;
+	PackedGrade	packed;
 
 	if (str == NULL || verm == NULL)
 		return 1;
 
 	assert(verm->value);
 
-	if (strlen(str) < 2)
-		return 1;
-
-	if (strncasecmp(str, "v", 1) != 0)
-		return 1;
-
-	errno = 0;
-	value = strtol(str + 1, NULL, 10);
-
-	if (errno == ERANGE || value < 0 || value > 255)
+	if (packed_grade_parse(str, VERMTYPE, &packed) != 0)
 		return 1;
 
-	memcpy(verm->value, &value, sizeof(uint8_t));
+	verm_set_value(verm, packed_grade_value(packed));
 	return 0;
 }
 
@@ -134,15 +173,10 @@ Verm *verm_from_string(const char *str)
 
 char *verm_format(const Verm *verm)
 {
-	char	*str;
-
 	if (verm == NULL)
 		return NULL;
 
-	str = malloc(5 * sizeof(char));
-	snprintf(str, 5, "V%d", verm_get_value(verm));
-
-	return str;
+	return packed_grade_to_string(packed_grade_make(VERMTYPE, verm_get_value(verm)));
 }
 
 Font *font_create(uint8_t initial_value)
@@ -150,8 +184,8 @@ Font *font_create(uint8_t initial_value)
 	Font *font;
 	uint8_t *value;
 
-	font = malloc(sizeof(Font));
-	value = malloc(sizeof(uint8_t));
+	font = climb_malloc(sizeof(Font));
+	value = climb_malloc(sizeof(uint8_t));
 
 	memcpy(value, &initial_value, sizeof(uint8_t));
 	font->value = value;
@@ -162,8 +196,8 @@ Font *font_create(uint8_t initial_value)
 
 void font_free(Font *font)
 {
-	free(font->value);
-	free(font);
+	climb_free(font->value);
+	climb_free(font);
 }
 
 int font_cmp(const Font *f1, const Font *f2)
@@ -181,29 +215,22 @@ void font_set_value(Font *font, uint8_t value)
 	memcpy(font->value, &value, sizeof(uint8_t));
 }
 
-static char get_first_char(const char *str, const char **endptr)
-{
-	if (!strlen(str))
-		return '\0';
-
-	if (endptr)
-		*endptr = str + 1;
-	return str[0];
-}
-
 static int calc_font_value(unsigned int n, char m, int p, uint8_t *value)
 {
 	char mods[] = { 'A', 'B', 'C' };
+	unsigned int v;
 
 	if (!value)
-		return 1;
+		return GRADE_PARSE_SYNTAX;
+
+	if (n < 1)
+		return GRADE_PARSE_OUT_OF_RANGE;
 
 	// ensure p is 1 or 0
 	p = p ? 1 : 0;
 
-	// TODO protect against overflows
 	if (n < 6) {
-		*value = 2 * (n - 1) + p;
+		v = 2 * (n - 1) + p;
 	} else {
 		int m_i = -1;
 		for (int i = 0; i < 3; i++) {
@@ -214,54 +241,31 @@ static int calc_font_value(unsigned int n, char m, int p, uint8_t *value)
 		}
 
 		if (m_i == -1)
-			return 1;
+			return GRADE_PARSE_SYNTAX;
 
-		*value = 10 + 6 * (n - 6) + m_i;
+		v = 10 + 6 * (n - 6) + m_i;
 	}
 
-	return 0;
+	if (v > UINT8_MAX)
+		return GRADE_PARSE_OUT_OF_RANGE;
+
+	*value = v;
+	return GRADE_PARSE_OK;
 }
 
 int font_parse(Font *font, const char *str)
 {
-	char	*endptr;
-	char	m = '\0';
-	int	has_plus;
-	uint8_t	value;
-	unsigned int	n;
+	PackedGrade	packed;
 
 	if (str == NULL || font == NULL)
 		return 1;
 
 	assert(font->value);
 
-	if (strlen(str) < 2)
-		return 1;
-
-	if (strncmp(str, "F", 1) != 0)
-		return 1;
-
-	str += 1;
-
-	errno = 0;
-	n = strtoul(str, &endptr, 10);
-
-	if (errno)
-		return 1;
-
-	str = endptr;
-
-	if (n > 5)
-		m = get_first_char(str, (const char **)&endptr);
-
-	str = endptr;
-
-	has_plus = strncmp(str, "+", 1) == 0;
-
-	if (calc_font_value(n, m, has_plus, &value) != 0)
+	if (packed_grade_parse(str, FONTTYPE, &packed) != 0)
 		return 1;
 
-	memcpy(font->value, &value, sizeof(uint8_t));
+	font_set_value(font, packed_grade_value(packed));
 	return 0;
 }
 
@@ -279,43 +283,10 @@ Font *font_from_string(const char *str)
 
 char *font_format(const Font *font)
 {
-	char	*str;
-	char	*cur;
-	char	m;
-	const char	mods[]= {'A', 'A', 'B', 'B', 'C', 'C'};
-	int	m_i;
-	int	p;
-	uint8_t	n;
-	uint8_t	value;
-
 	if (font == NULL)
 		return NULL;
 
-	value = *font->value;
-
-	if (value < 10) {
-		n = (value / 2) + 1;
-		p = value % 2 == 1;
-	} else {
-		n = 6 + (value - 10) / 6;
-		m_i = (value - 10) % 6;
-		m = mods[m_i];
-		p = (m_i % 2 == 1);
-	}
-
-	// 6 is the largest potential strlen for a uint8_t
-	str = malloc(6 * sizeof(char));
-
-	cur = str;
-	cur += snprintf(cur, 4, "F%d", n);
-
-	if (value > 9)
-		cur += snprintf(cur, 2, "%c", m);
-
-	if (p)
-		snprintf(cur, 2, "+");
-
-	return str;
+	return packed_grade_to_string(packed_grade_make(FONTTYPE, font_get_value(font)));
 }
 
 Yds *yds_create(uint8_t initial_value)
@@ -323,8 +294,8 @@ Yds *yds_create(uint8_t initial_value)
 	Yds *yds;
 	uint8_t *value;
 
-	yds = malloc(sizeof(Yds));
-	value = malloc(sizeof(uint8_t));
+	yds = climb_malloc(sizeof(Yds));
+	value = climb_malloc(sizeof(uint8_t));
 
 	memcpy(value, &initial_value, sizeof(uint8_t));
 	yds->value = value;
@@ -335,8 +306,8 @@ Yds *yds_create(uint8_t initial_value)
 
 void yds_free(Yds *yds)
 {
-	free(yds->value);
-	free(yds);
+	climb_free(yds->value);
+	climb_free(yds);
 }
 
 int yds_cmp(const Yds *y1, const Yds *y2)
@@ -357,13 +328,16 @@ void yds_set_value(Yds *yds, uint8_t value)
 static int calc_yds_value(unsigned int n, char m, uint8_t *value)
 {
 	char mods[] = { 'a', 'b', 'c', 'd' };
+	unsigned int v;
 
 	if (!value)
-		return 1;
+		return GRADE_PARSE_SYNTAX;
+
+	if (n < 1)
+		return GRADE_PARSE_OUT_OF_RANGE;
 
-	// TODO protect against overflows
 	if (n < 10) {
-		*value = n - 1;
+		v = n - 1;
 	} else {
 		int m_i = -1;
 		for (int i = 0; i < 4; i++) {
@@ -374,54 +348,31 @@ static int calc_yds_value(unsigned int n, char m, uint8_t *value)
 		}
 
 		if (m_i == -1)
-			return 1;
+			return GRADE_PARSE_SYNTAX;
 
-		*value = 9 + (n - 10) * 4 + m_i;
+		v = 9 + (n - 10) * 4 + m_i;
 	}
 
-	return 0;
+	if (v > UINT8_MAX)
+		return GRADE_PARSE_OUT_OF_RANGE;
+
+	*value = v;
+	return GRADE_PARSE_OK;
 }
 
 int yds_parse(Yds *yds, const char *str)
 {
-	char	*endptr;
-	char	m = '\0';
-	uint8_t	value;
-	unsigned int	n;
+	PackedGrade	packed;
 
 	if (str == NULL || yds == NULL)
 		return 1;
 
 	assert(yds->value);
 
-	if (strlen(str) < 3)
-		return 1;
-
-	if (strncmp(str, "5.", 2) != 0)
-		return 1;
-
-	str += 2;
-
-	errno = 0;
-	n = strtoul(str, &endptr, 10);
-
-	if (errno)
-		return 1;
-
-	str = endptr;
-
-	if (n > 9)
-		m = get_first_char(str, (const char **)&endptr);
-
-	str = endptr;
-
-	if (strlen(str))
-		return 1;
-
-	if (calc_yds_value(n, m, &value) != 0)
+	if (packed_grade_parse(str, YDSTYPE, &packed) != 0)
 		return 1;
 
-	memcpy(yds->value, &value, sizeof(uint8_t));
+	yds_set_value(yds, packed_grade_value(packed));
 	return 0;
 }
 
@@ -439,57 +390,20 @@ Yds *yds_from_string(const char *str)
 
 char *yds_format(const Yds *yds)
 {
-	char	*str;
-	char	*cur;
-	char	m;
-	const char	mods[]= {'a', 'b', 'c', 'd'};
-	int	m_i;
-	uint8_t	n;
-	uint8_t	value;
-
 	if (yds == NULL)
 		return NULL;
 
-	value = *yds->value;
-
-	if (value < 9) {
-		n = value + 1;
-	} else {
-		n = 10 + (value - 9) / 4;
-		m_i = (value - 9) % 4;
-		m = mods[m_i];
-	}
-
-	// 6 is the largest potential strlen for a uint8_t
-	str = malloc(6 * sizeof(char));
-
-	cur = str;
-	cur += snprintf(cur, 5, "5.%d", n);
-
-	if (n > 9) // >5.9
-		cur += snprintf(cur, 2, "%c", m);
-
-	return str;
+	return packed_grade_to_string(packed_grade_make(YDSTYPE, yds_get_value(yds)));
 }
 
 Grade *grade_from_string(const char *str, uint32_t type_hint)
 {
-	Grade	*grade;
+	PackedGrade	packed;
 
-	// TODO It'd be great to test this type-hinting
-	switch (type_hint) {
-		case ANYTYPE: // try all until one hits
-		case VERMTYPE:
-			if ((grade = (Grade*)verm_from_string(str)) != NULL || type_hint) break;
-		case FONTTYPE:
-			if ((grade = (Grade*)font_from_string(str)) != NULL || type_hint) break;
-		case YDSTYPE:
-			if ((grade = (Grade*)yds_from_string(str)) != NULL || type_hint) break;
-		default:
-			grade = NULL;
-	}
+	if (packed_grade_parse(str, type_hint, &packed) != 0)
+		return NULL;
 
-	return grade;
+	return grade_from_packed(packed);
 }
 
 void grade_free(Grade *grade)
@@ -509,16 +423,7 @@ void grade_free(Grade *grade)
 
 char *grade_to_string(Grade *grade)
 {
-	switch (grade->type) {
-		case VERMTYPE:
-			return verm_format((Verm *)grade);
-		case FONTTYPE:
-			return font_format((Font *)grade);
-		case YDSTYPE:
-			return yds_format((Yds *)grade);
-		default:
-			return NULL;
-	}
+	return packed_grade_to_string(packed_grade_from_grade(grade));
 }
 
 int grade_cmp(const Grade *g1, const Grade *g2)
@@ -554,13 +459,42 @@ int grade_cmp(const Grade *g1, const Grade *g2)
 
 void serialized_grade_free(SerializedGrade *grade)
 {
-	free(grade);
+	climb_free(grade);
 }
 
+// The header's high bit is always set, the first byte of a 0.1 grade's type
+// word never has it
+#define HEADER_COMPACT	0x80
+#define HEADER_VERSION_SHIFT	4
+#define HEADER_VERSION_MASK	0x07
+#define HEADER_FLAGS_SHIFT	2
+#define HEADER_FLAGS_MASK	0x03
+#define HEADER_TYPE_MASK	0x03
+
 static size_t size_of_uint8_grade()
 {
-	// type + *->value
-	return sizeof(u_int32_t) + sizeof(uint8_t);
+	// header + *->value
+	return sizeof(uint8_t) + sizeof(uint8_t);
+}
+
+// reads either layout, returning the size it took up
+static size_t read_uint8_grade(const uint8_t *buf, uint32_t *type, uint8_t *value)
+{
+	if (!(buf[0] & HEADER_COMPACT)) {
+		*type = serialized_grade_data_read_uint32_t(buf);
+		*value = serialized_grade_data_read_uint8_t(buf + sizeof(uint32_t));
+		return sizeof(uint32_t) + sizeof(uint8_t);
+	}
+
+	// a grade written by a newer version can't be read, leave it typeless
+	// so that it is rejected like any other invalid grade
+	if (serialized_grade_data_version(buf) > SERIALIZED_GRADE_VERSION)
+		*type = ANYTYPE;
+	else
+		*type = buf[0] & HEADER_TYPE_MASK;
+
+	*value = serialized_grade_data_read_uint8_t(buf + sizeof(uint8_t));
+	return size_of_uint8_grade();
 }
 
 size_t serialized_grade_size_from_verm(void)
@@ -576,11 +510,9 @@ SerializedGrade *serialized_grade_from_verm(const Verm *verm, size_t *size)
 	uint8_t	*ptr;
 
 	expected_size = serialized_grade_size_from_verm();
-	ptr = malloc(expected_size);
+	ptr = climb_malloc(expected_size);
 	grade = (SerializedGrade *)ptr;
 
-	// TODO here is where flags could be added to ptr
-
 	ptr += serialized_grade_buffer_write_verm(verm, ptr);
 
 	actual_size = ptr - (uint8_t*)grade;
@@ -601,11 +533,9 @@ SerializedGrade *serialized_grade_from_font(const Font *font, size_t *size)
 	uint8_t	*ptr;
 
 	expected_size = serialized_grade_size_from_font();
-	ptr = malloc(expected_size);
+	ptr = climb_malloc(expected_size);
 	grade = (SerializedGrade *)ptr;
 
-	// TODO here is where flags could be added to ptr
-
 	ptr += serialized_grade_buffer_write_font(font, ptr);
 
 	actual_size = ptr - (uint8_t*)grade;
@@ -636,11 +566,9 @@ SerializedGrade *serialized_grade_from_yds(const Yds *yds, size_t *size)
 	uint8_t	*ptr;
 
 	expected_size = serialized_grade_size_from_yds();
-	ptr = malloc(expected_size);
+	ptr = climb_malloc(expected_size);
 	grade = (SerializedGrade *)ptr;
 
-	// TODO here is where flags could be added to ptr
-
 	ptr += serialized_grade_buffer_write_yds(yds, ptr);
 
 	actual_size = ptr - (uint8_t*)grade;
@@ -660,17 +588,10 @@ Grade *grade_from_serialized(const SerializedGrade *serialized)
 
 int serialized_grade_cmp(const SerializedGrade *sg1, const SerializedGrade *sg2)
 {
-	int ret;
-	Grade *g1;
-	Grade *g2;
-
-	g1 = grade_from_serialized(sg1);
-	g2 = grade_from_serialized(sg2);
-	ret = grade_cmp(g1, g2);
-
-	grade_free(g1);
-	grade_free(g2);
-	return ret;
+	// compare the type and value in place, this runs for every comparison
+	// an index or sort makes so it must not allocate
+	return packed_grade_cmp(packed_grade_from_serialized(sg1),
+				packed_grade_from_serialized(sg2));
 }
 
 SerializedGrade *serialized_grade_from_grade(const Grade *grade, size_t *size)
@@ -691,7 +612,7 @@ Grade *grade_from_serialized_grade_data(uint8_t *buf)
 {
 	uint32_t type;
 
-	type = serialized_grade_data_read_uint32_t(buf);
+	type = serialized_grade_data_type(buf);
 
 	switch (type) {
 		case VERMTYPE:
@@ -707,61 +628,76 @@ Grade *grade_from_serialized_grade_data(uint8_t *buf)
 
 Verm *verm_from_serialized_grade_data(const uint8_t *buf, size_t *size)
 {
-	const uint8_t *loc;
 	Verm *verm;
+	uint32_t type;
+	uint8_t value;
+	size_t read;
 
-	verm = verm_create(0);
-	verm->type = VERMTYPE;
+	read = read_uint8_grade(buf, &type, &value);
 
-	loc = buf;
-	loc += sizeof(uint32_t); // skip type
-	verm_set_value(verm, serialized_grade_data_read_uint8_t(loc));
-	loc += sizeof(uint8_t);
+	verm = verm_create(value);
+	verm->type = VERMTYPE;
 
 	if (size)
-		*size = loc - buf;
+		*size = read;
 
 	return verm;
 }
 
 Font *font_from_serialized_grade_data(const uint8_t *buf, size_t *size)
 {
-	const uint8_t *loc;
 	Font *font;
+	uint32_t type;
+	uint8_t value;
+	size_t read;
 
-	font = font_create(0);
-	font->type = FONTTYPE;
+	read = read_uint8_grade(buf, &type, &value);
 
-	loc = buf;
-	loc += sizeof(uint32_t); // skip type
-	font_set_value(font, serialized_grade_data_read_uint8_t(loc));
-	loc += sizeof(uint8_t);
+	font = font_create(value);
+	font->type = FONTTYPE;
 
 	if (size)
-		*size = loc - buf;
+		*size = read;
 
 	return font;
 }
 
 Yds *yds_from_serialized_grade_data(const uint8_t *buf, size_t *size)
 {
-	const uint8_t *loc;
 	Yds *yds;
+	uint32_t type;
+	uint8_t value;
+	size_t read;
 
-	yds = yds_create(0);
-	yds->type = YDSTYPE;
+	read = read_uint8_grade(buf, &type, &value);
 
-	loc = buf;
-	loc += sizeof(uint32_t); // skip type
-	yds_set_value(yds, serialized_grade_data_read_uint8_t(loc));
-	loc += sizeof(uint8_t);
+	yds = yds_create(value);
+	yds->type = YDSTYPE;
 
 	if (size)
-		*size = loc - buf;
+		*size = read;
 
 	return yds;
 }
 
+uint32_t serialized_grade_data_version(const uint8_t *buf)
+{
+	// grades from 0.1 are the unversioned format 0
+	if (!(buf[0] & HEADER_COMPACT))
+		return 0;
+
+	return (buf[0] >> HEADER_VERSION_SHIFT) & HEADER_VERSION_MASK;
+}
+
+uint32_t serialized_grade_data_type(const uint8_t *buf)
+{
+	uint32_t type;
+	uint8_t value;
+
+	read_uint8_grade(buf, &type, &value);
+	return type;
+}
+
 uint32_t serialized_grade_data_read_uint32_t(const uint8_t *buf)
 {
 	return *((uint32_t*)buf);
@@ -787,13 +723,32 @@ static size_t buffer_write_uint32_t(uint8_t *buf, uint32_t data)
 static size_t buffer_write_uint8_grade(uint8_t *buf, uint32_t type, uint8_t value)
 {
 	uint8_t *loc = buf;
+	uint8_t header = HEADER_COMPACT
+		| (SERIALIZED_GRADE_VERSION << HEADER_VERSION_SHIFT)
+		| (type & HEADER_TYPE_MASK);
 
-	loc += buffer_write_uint32_t(loc, type);
+	loc += buffer_write_uint8_t(loc, header);
 	loc += buffer_write_uint8_t(loc, value);
 
 	return loc - buf;
 }
 
+size_t serialized_grade_size_unversioned(void)
+{
+	// type + *->value
+	return sizeof(uint32_t) + sizeof(uint8_t);
+}
+
+size_t serialized_grade_buffer_write_unversioned(PackedGrade packed, uint8_t *buf)
+{
+	uint8_t *loc = buf;
+
+	loc += buffer_write_uint32_t(loc, packed_grade_type(packed));
+	loc += buffer_write_uint8_t(loc, packed_grade_value(packed));
+
+	return loc - buf;
+}
+
 size_t serialized_grade_buffer_write_verm(const Verm *verm, uint8_t *buf)
 {
 	return buffer_write_uint8_grade(buf, VERMTYPE, verm_get_value(verm));
@@ -808,3 +763,982 @@ size_t serialized_grade_buffer_write_yds(const Yds *yds, uint8_t *buf)
 {
 	return buffer_write_uint8_grade(buf, YDSTYPE, yds_get_value(yds));
 }
+
+PackedGrade packed_grade_make(uint32_t type, uint8_t value)
+{
+	return ((type & 0xFF) << 8) | value;
+}
+
+uint32_t packed_grade_type(PackedGrade packed)
+{
+	return (packed >> 8) & 0xFF;
+}
+
+uint8_t packed_grade_value(PackedGrade packed)
+{
+	return packed & 0xFF;
+}
+
+PackedGrade packed_grade_from_grade(const Grade *grade)
+{
+	switch (grade->type) {
+		case VERMTYPE:
+			return packed_grade_make(VERMTYPE, verm_get_value((Verm *)grade));
+		case FONTTYPE:
+			return packed_grade_make(FONTTYPE, font_get_value((Font *)grade));
+		case YDSTYPE:
+			return packed_grade_make(YDSTYPE, yds_get_value((Yds *)grade));
+		default:
+			return packed_grade_make(ANYTYPE, 0);
+	}
+}
+
+PackedGrade packed_grade_from_serialized(const SerializedGrade *serialized)
+{
+	uint32_t type;
+	uint8_t value;
+
+	read_uint8_grade((const uint8_t *)serialized->data, &type, &value);
+
+	return packed_grade_make(type, value);
+}
+
+Grade *grade_from_packed(PackedGrade packed)
+{
+	uint8_t value = packed_grade_value(packed);
+
+	switch (packed_grade_type(packed)) {
+		case VERMTYPE:
+			return (Grade *)verm_create(value);
+		case FONTTYPE:
+			return (Grade *)font_create(value);
+		case YDSTYPE:
+			return (Grade *)yds_create(value);
+		default:
+			return NULL;
+	}
+}
+
+int packed_grade_cmp(PackedGrade p1, PackedGrade p2)
+{
+	uint32_t k1 = p1 & 0xFFFF;
+	uint32_t k2 = p2 & 0xFFFF;
+
+	return (k1 > k2) - (k1 < k2);
+}
+
+// Every value of every scale is a grade, so the grade following the hardest of
+// one scale is the easiest of the next. This is the order packed_grade_cmp
+// sorts in, which is what makes grade ranges discrete.
+int packed_grade_next(PackedGrade packed, PackedGrade *next)
+{
+	uint32_t type = packed_grade_type(packed);
+	uint8_t value = packed_grade_value(packed);
+
+	if (type != VERMTYPE && type != FONTTYPE && type != YDSTYPE)
+		return 1;
+
+	if (value < UINT8_MAX)
+		*next = packed_grade_make(type, value + 1);
+	else if (type < YDSTYPE)
+		*next = packed_grade_make(type + 1, 0);
+	else
+		return 1;
+
+	return 0;
+}
+
+// The number of grades from p2 up to p1, negative if p1 is the easier one
+int32_t packed_grade_distance(PackedGrade p1, PackedGrade p2)
+{
+	return (int32_t)(p1 & 0xFFFF) - (int32_t)(p2 & 0xFFFF);
+}
+
+size_t packed_grade_buffer_size(void)
+{
+	// type + value
+	return sizeof(uint8_t) + sizeof(uint8_t);
+}
+
+size_t packed_grade_buffer_write(PackedGrade packed, uint8_t *buf)
+{
+	uint8_t *loc = buf;
+
+	loc += buffer_write_uint8_t(loc, packed_grade_type(packed));
+	loc += buffer_write_uint8_t(loc, packed_grade_value(packed));
+
+	return loc - buf;
+}
+
+PackedGrade packed_grade_from_buffer(const uint8_t *buf, size_t *size)
+{
+	const uint8_t *loc;
+	uint8_t type;
+	uint8_t value;
+
+	loc = buf;
+	type = serialized_grade_data_read_uint8_t(loc);
+	loc += sizeof(uint8_t);
+	value = serialized_grade_data_read_uint8_t(loc);
+	loc += sizeof(uint8_t);
+
+	if (size)
+		*size = loc - buf;
+
+	return packed_grade_make(type, value);
+}
+
+// Conversion between scales goes through the V-scale. Each table maps the
+// grades of one scale to the V-grade they are commonly considered equivalent
+// to, or the reverse. The mapping is lossy, grades easier than V0 convert to
+// V0 and grades harder than the tables have no equivalent at all.
+#define TABLE_SIZE(table) (sizeof(table) / sizeof((table)[0]))
+
+// V0 to V17
+static const uint8_t verm_to_font[] = {
+	6, 8, 9, 10, 12, 14, 16, 17, 18, 20, 21, 22, 23, 24, 25, 26, 27, 28
+};
+static const uint8_t verm_to_yds[] = {
+	10, 12, 14, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30
+};
+
+// F1 to F9A
+static const uint8_t font_to_verm[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 3, 4, 4, 5, 5, 6, 7, 8, 8,
+	9, 10, 11, 12, 13, 14, 15, 16, 17
+};
+
+// 5.1 to 5.15b
+static const uint8_t yds_to_verm[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 3, 4, 5, 6,
+	7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17
+};
+
+static int convert_to_verm(uint32_t type, uint8_t value, uint8_t *verm)
+{
+	switch (type) {
+		case VERMTYPE:
+			*verm = value;
+			return 0;
+		case FONTTYPE:
+			if (value >= TABLE_SIZE(font_to_verm))
+				return 1;
+			*verm = font_to_verm[value];
+			return 0;
+		case YDSTYPE:
+			if (value >= TABLE_SIZE(yds_to_verm))
+				return 1;
+			*verm = yds_to_verm[value];
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+static int convert_from_verm(uint32_t type, uint8_t verm, uint8_t *value)
+{
+	switch (type) {
+		case VERMTYPE:
+			*value = verm;
+			return 0;
+		case FONTTYPE:
+			if (verm >= TABLE_SIZE(verm_to_font))
+				return 1;
+			*value = verm_to_font[verm];
+			return 0;
+		case YDSTYPE:
+			if (verm >= TABLE_SIZE(verm_to_yds))
+				return 1;
+			*value = verm_to_yds[verm];
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+int packed_grade_convert(PackedGrade packed, uint32_t type, PackedGrade *converted)
+{
+	uint32_t from = packed_grade_type(packed);
+	uint8_t verm;
+	uint8_t value;
+
+	if (from != VERMTYPE && from != FONTTYPE && from != YDSTYPE)
+		return 1;
+
+	if (type == ANYTYPE || type == from) {
+		*converted = packed;
+		return 0;
+	}
+
+	if (convert_to_verm(from, packed_grade_value(packed), &verm) != 0
+	    || convert_from_verm(type, verm, &value) != 0)
+		return 1;
+
+	*converted = packed_grade_make(type, value);
+	return 0;
+}
+
+// Reads an unsigned decimal number, failing rather than exceeding max
+static int scan_uint(const char **str, unsigned int max, unsigned int *n)
+{
+	const char *cur = *str;
+	unsigned int value = 0;
+
+	if (*cur < '0' || *cur > '9')
+		return GRADE_PARSE_SYNTAX;
+
+	while (*cur >= '0' && *cur <= '9') {
+		value = value * 10 + (*cur - '0');
+
+		if (value > max)
+			return GRADE_PARSE_OUT_OF_RANGE;
+
+		cur++;
+	}
+
+	*str = cur;
+	*n = value;
+	return GRADE_PARSE_OK;
+}
+
+// V<n>
+static int scan_verm(const char *str, uint8_t *value)
+{
+	unsigned int n;
+	int ret;
+
+	if ((ret = scan_uint(&str, UINT8_MAX, &n)) != GRADE_PARSE_OK)
+		return ret;
+
+	if (*str != '\0')
+		return GRADE_PARSE_SYNTAX;
+
+	*value = n;
+	return GRADE_PARSE_OK;
+}
+
+// F<n>[+] for n < 6, F<n><A|B|C>[+] otherwise
+static int scan_font(const char *str, uint8_t *value)
+{
+	char m = '\0';
+	int p;
+	int ret;
+	unsigned int n;
+
+	if ((ret = scan_uint(&str, UINT8_MAX, &n)) != GRADE_PARSE_OK)
+		return ret;
+
+	if (n > 5 && *str != '\0')
+		m = *str++;
+
+	p = *str == '+';
+
+	if (p)
+		str++;
+
+	if (*str != '\0')
+		return GRADE_PARSE_SYNTAX;
+
+	return calc_font_value(n, m, p, value);
+}
+
+// 5.<n> for n < 10, 5.<n><a|b|c|d> otherwise
+static int scan_yds(const char *str, uint8_t *value)
+{
+	char m = '\0';
+	int ret;
+	unsigned int n;
+
+	if ((ret = scan_uint(&str, UINT8_MAX, &n)) != GRADE_PARSE_OK)
+		return ret;
+
+	if (n > 9 && *str != '\0')
+		m = *str++;
+
+	if (*str != '\0')
+		return GRADE_PARSE_SYNTAX;
+
+	return calc_yds_value(n, m, value);
+}
+
+int packed_grade_parse(const char *str, uint32_t type_hint, PackedGrade *packed)
+{
+	int	ret;
+	uint32_t	type;
+	uint8_t	value;
+
+	// there is nothing to parse, or nowhere to put it
+	if (str == NULL || str[0] == '\0' || packed == NULL)
+		return GRADE_PARSE_EMPTY;
+
+	// every scale is recognizable by its first character, so the string is
+	// only ever scanned once
+	switch (str[0]) {
+		case 'V':
+		case 'v':
+			type = VERMTYPE;
+			ret = scan_verm(str + 1, &value);
+			break;
+		case 'F':
+			type = FONTTYPE;
+			ret = scan_font(str + 1, &value);
+			break;
+		case '5':
+			type = YDSTYPE;
+			ret = str[1] == '.' ? scan_yds(str + 2, &value) : GRADE_PARSE_SYNTAX;
+			break;
+		default:
+			return GRADE_PARSE_UNKNOWN_SCALE;
+	}
+
+	if (ret != GRADE_PARSE_OK)
+		return ret;
+
+	if (type_hint != ANYTYPE && type_hint != type)
+		return GRADE_PARSE_WRONG_SCALE;
+
+	*packed = packed_grade_make(type, value);
+	return GRADE_PARSE_OK;
+}
+
+// Every scale has at most 256 values, so rather than formatting a grade each
+// time it is output, every string is formatted once into these tables
+static char grade_strings[YDSTYPE + 1][UINT8_MAX + 1][GRADE_STRING_SIZE];
+static uint8_t grade_string_lengths[YDSTYPE + 1][UINT8_MAX + 1];
+static int grade_strings_built = 0;
+
+static int write_verm_string(uint8_t value, char *str)
+{
+	return snprintf(str, GRADE_STRING_SIZE, "V%d", value);
+}
+
+static int write_font_string(uint8_t value, char *str)
+{
+	char	*cur;
+	char	m;
+	const char	mods[]= {'A', 'A', 'B', 'B', 'C', 'C'};
+	int	m_i;
+	int	p;
+	uint8_t	n;
+
+	if (value < 10) {
+		n = (value / 2) + 1;
+		p = value % 2 == 1;
+	} else {
+		n = 6 + (value - 10) / 6;
+		m_i = (value - 10) % 6;
+		m = mods[m_i];
+		p = (m_i % 2 == 1);
+	}
+
+	cur = str;
+	cur += snprintf(cur, 4, "F%d", n);
+
+	if (value > 9)
+		cur += snprintf(cur, 2, "%c", m);
+
+	if (p)
+		cur += snprintf(cur, 2, "+");
+
+	return cur - str;
+}
+
+static int write_yds_string(uint8_t value, char *str)
+{
+	char	*cur;
+	char	m;
+	const char	mods[]= {'a', 'b', 'c', 'd'};
+	int	m_i;
+	uint8_t	n;
+
+	if (value < 9) {
+		n = value + 1;
+	} else {
+		n = 10 + (value - 9) / 4;
+		m_i = (value - 9) % 4;
+		m = mods[m_i];
+	}
+
+	cur = str;
+	cur += snprintf(cur, 5, "5.%d", n);
+
+	if (n > 9) // >5.9
+		cur += snprintf(cur, 2, "%c", m);
+
+	return cur - str;
+}
+
+static void build_grade_strings(void)
+{
+	for (int v = 0; v <= UINT8_MAX; v++) {
+		grade_string_lengths[VERMTYPE][v] = write_verm_string(v, grade_strings[VERMTYPE][v]);
+		grade_string_lengths[FONTTYPE][v] = write_font_string(v, grade_strings[FONTTYPE][v]);
+		grade_string_lengths[YDSTYPE][v] = write_yds_string(v, grade_strings[YDSTYPE][v]);
+	}
+
+	grade_strings_built = 1;
+}
+
+const char *packed_grade_string(PackedGrade packed, size_t *len)
+{
+	uint32_t type = packed_grade_type(packed);
+	uint8_t value = packed_grade_value(packed);
+
+	if (type != VERMTYPE && type != FONTTYPE && type != YDSTYPE)
+		return NULL;
+
+	if (!grade_strings_built)
+		build_grade_strings();
+
+	if (len)
+		*len = grade_string_lengths[type][value];
+
+	return grade_strings[type][value];
+}
+
+char *packed_grade_to_string(PackedGrade packed)
+{
+	const char *str;
+	char *dup;
+	size_t len;
+
+	str = packed_grade_string(packed, &len);
+
+	if (!str)
+		return NULL;
+
+	dup = climb_malloc(len + 1);
+	memcpy(dup, str, len + 1);
+
+	return dup;
+}
+
+static int valid_type(uint32_t type)
+{
+	return type == VERMTYPE || type == FONTTYPE || type == YDSTYPE;
+}
+
+// Counts are never negative, uncounting more grades than were counted fails
+// rather than leaving a count the percentiles and the mode can't make sense of
+static int add_count(int64_t *count, int64_t n)
+{
+	if ((n > 0 && *count > INT64_MAX - n) || (n < 0 && *count + n < 0))
+		return 1;
+
+	*count += n;
+	return 0;
+}
+
+static int subtract_count(int64_t *count, int64_t n)
+{
+	if ((n < 0 && *count > INT64_MAX + n) || (n > 0 && *count - n < 0))
+		return 1;
+
+	*count -= n;
+	return 0;
+}
+
+GradeHistogram *grade_histogram_create(void)
+{
+	GradeHistogram *histogram;
+
+	histogram = climb_malloc(sizeof(GradeHistogram));
+	memset(histogram, 0, sizeof(GradeHistogram));
+
+	return histogram;
+}
+
+void grade_histogram_free(GradeHistogram *histogram)
+{
+	climb_free(histogram);
+}
+
+int grade_histogram_add(GradeHistogram *histogram, PackedGrade packed, int64_t count)
+{
+	uint32_t type = packed_grade_type(packed);
+
+	if (!valid_type(type))
+		return 1;
+
+	return add_count(&histogram->counts[type - 1][packed_grade_value(packed)], count);
+}
+
+int64_t grade_histogram_count(const GradeHistogram *histogram, PackedGrade packed)
+{
+	uint32_t type = packed_grade_type(packed);
+
+	if (!valid_type(type))
+		return 0;
+
+	return histogram->counts[type - 1][packed_grade_value(packed)];
+}
+
+int grade_histogram_combine(GradeHistogram *histogram, const GradeHistogram *other)
+{
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (add_count(&histogram->counts[t][v], other->counts[t][v]) != 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+int grade_histogram_subtract(GradeHistogram *histogram, const GradeHistogram *other)
+{
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (subtract_count(&histogram->counts[t][v], other->counts[t][v]) != 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static uint32_t histogram_entries(const GradeHistogram *histogram)
+{
+	uint32_t entries = 0;
+
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (histogram->counts[t][v] != 0)
+				entries++;
+		}
+	}
+
+	return entries;
+}
+
+static size_t histogram_entry_size(void)
+{
+	// type + value + count
+	return sizeof(uint8_t) + sizeof(uint8_t) + sizeof(int64_t);
+}
+
+size_t grade_histogram_buffer_size(const GradeHistogram *histogram)
+{
+	return sizeof(uint32_t) + histogram_entries(histogram) * histogram_entry_size();
+}
+
+size_t grade_histogram_buffer_write(const GradeHistogram *histogram, uint8_t *buf)
+{
+	uint8_t *loc = buf;
+
+	loc += buffer_write_uint32_t(loc, histogram_entries(histogram));
+
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (histogram->counts[t][v] == 0)
+				continue;
+
+			loc += buffer_write_uint8_t(loc, t + 1);
+			loc += buffer_write_uint8_t(loc, v);
+			memcpy(loc, &histogram->counts[t][v], sizeof(int64_t));
+			loc += sizeof(int64_t);
+		}
+	}
+
+	return loc - buf;
+}
+
+int grade_histogram_from_buffer(GradeHistogram *histogram, const uint8_t *buf, size_t size)
+{
+	const uint8_t *loc = buf;
+	uint32_t entries;
+	int64_t count;
+
+	memset(histogram->counts, 0, sizeof(histogram->counts));
+
+	if (size < sizeof(uint32_t))
+		return 1;
+
+	memcpy(&entries, loc, sizeof(uint32_t));
+	loc += sizeof(uint32_t);
+
+	if ((size - sizeof(uint32_t)) / histogram_entry_size() != entries
+	    || (size - sizeof(uint32_t)) % histogram_entry_size() != 0)
+		return 1;
+
+	for (uint32_t i = 0; i < entries; i++) {
+		memcpy(&count, loc + 2 * sizeof(uint8_t), sizeof(int64_t));
+
+		if (count < 0
+		    || grade_histogram_add(histogram, packed_grade_make(loc[0], loc[1]), count) != 0)
+			return 1;
+
+		loc += histogram_entry_size();
+	}
+
+	return 0;
+}
+
+// Reads an optionally negative decimal number, failing rather than overflowing
+static int scan_int64(const char **str, int64_t *n)
+{
+	const char *cur = *str;
+	int negative = *cur == '-';
+	uint64_t max;
+	uint64_t value = 0;
+
+	if (negative)
+		cur++;
+
+	max = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+
+	if (*cur < '0' || *cur > '9')
+		return 1;
+
+	while (*cur >= '0' && *cur <= '9') {
+		if (value > (max - (*cur - '0')) / 10)
+			return 1;
+
+		value = value * 10 + (*cur - '0');
+		cur++;
+	}
+
+	*str = cur;
+	*n = negative ? -(int64_t)(value - 1) - 1 : (int64_t)value;
+	return 0;
+}
+
+// {<grade>:<count>[,<grade>:<count>...]}
+int grade_histogram_parse(GradeHistogram *histogram, const char *str)
+{
+	char grade[GRADE_STRING_SIZE];
+	const char *cur = str;
+	PackedGrade packed;
+	int64_t count;
+	size_t len;
+
+	memset(histogram->counts, 0, sizeof(histogram->counts));
+
+	if (str == NULL || *cur++ != '{')
+		return 1;
+
+	if (*cur == '}')
+		return cur[1] != '\0';
+
+	for (;;) {
+		len = strcspn(cur, ":");
+
+		if (len == 0 || len >= GRADE_STRING_SIZE || cur[len] != ':')
+			return 1;
+
+		memcpy(grade, cur, len);
+		grade[len] = '\0';
+		cur += len + 1;
+
+		if (packed_grade_parse(grade, ANYTYPE, &packed) != 0
+		    || scan_int64(&cur, &count) != 0
+		    || count < 0
+		    || grade_histogram_add(histogram, packed, count) != 0)
+			return 1;
+
+		if (*cur == '}')
+			break;
+
+		if (*cur++ != ',')
+			return 1;
+	}
+
+	return cur[1] != '\0';
+}
+
+char *grade_histogram_to_string(const GradeHistogram *histogram)
+{
+	char *str;
+	char *cur;
+	size_t size;
+
+	// every entry is at most a grade, a colon, a 20 digit count and a comma
+	size = 3 + histogram_entries(histogram) * (GRADE_STRING_SIZE + 22);
+	str = climb_malloc(size);
+	cur = str;
+
+	*cur++ = '{';
+
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (histogram->counts[t][v] == 0)
+				continue;
+
+			if (cur[-1] != '{')
+				*cur++ = ',';
+
+			cur += snprintf(cur, size - (cur - str), "%s:%" PRId64,
+					packed_grade_string(packed_grade_make(t + 1, v), NULL),
+					histogram->counts[t][v]);
+		}
+	}
+
+	*cur++ = '}';
+	*cur = '\0';
+
+	return str;
+}
+
+// Like percentile_disc, the first grade at or past the given fraction of the
+// counted grades. Walking the counts in grade order is a counting sort, there
+// is nothing to compare.
+int grade_histogram_percentile(const GradeHistogram *histogram, double fraction, PackedGrade *packed)
+{
+	int64_t total = 0;
+	int64_t target;
+	int64_t seen = 0;
+
+	if (!(fraction >= 0 && fraction <= 1))
+		return 1;
+
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (histogram->counts[t][v] > 0)
+				total += histogram->counts[t][v];
+		}
+	}
+
+	if (total == 0)
+		return 1;
+
+	// the position, counting from 1, rounded up
+	target = (int64_t)(fraction * total);
+
+	if ((double)target < fraction * total)
+		target++;
+
+	if (target < 1)
+		target = 1;
+
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (histogram->counts[t][v] <= 0)
+				continue;
+
+			seen += histogram->counts[t][v];
+
+			if (seen >= target) {
+				*packed = packed_grade_make(t + 1, v);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+// The most counted grade, the easiest of them if there is a tie
+int grade_histogram_mode(const GradeHistogram *histogram, PackedGrade *packed)
+{
+	int64_t best = 0;
+
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (histogram->counts[t][v] > best) {
+				best = histogram->counts[t][v];
+				*packed = packed_grade_make(t + 1, v);
+			}
+		}
+	}
+
+	return best == 0;
+}
+
+static int top_k_entry_cmp(const GradeTopKEntry *e1, const GradeTopKEntry *e2)
+{
+	int cmp = packed_grade_cmp(e1->grade, e2->grade);
+
+	if (cmp != 0)
+		return cmp;
+
+	return (e1->points > e2->points) - (e1->points < e2->points);
+}
+
+// hardest first
+static int top_k_entry_sort_cmp(const void *e1, const void *e2)
+{
+	return top_k_entry_cmp(e2, e1);
+}
+
+static void top_k_sift_up(GradeTopK *top, uint32_t i)
+{
+	GradeTopKEntry entry = top->entries[i];
+	uint32_t parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+
+		if (top_k_entry_cmp(&top->entries[parent], &entry) <= 0)
+			break;
+
+		top->entries[i] = top->entries[parent];
+		i = parent;
+	}
+
+	top->entries[i] = entry;
+}
+
+static void top_k_sift_down(GradeTopK *top, uint32_t i)
+{
+	GradeTopKEntry entry = top->entries[i];
+	uint32_t child;
+
+	while ((child = 2 * i + 1) < top->size) {
+		if (child + 1 < top->size
+		    && top_k_entry_cmp(&top->entries[child + 1], &top->entries[child]) < 0)
+			child++;
+
+		if (top_k_entry_cmp(&entry, &top->entries[child]) <= 0)
+			break;
+
+		top->entries[i] = top->entries[child];
+		i = child;
+	}
+
+	top->entries[i] = entry;
+}
+
+GradeTopK *grade_top_k_create(uint32_t k)
+{
+	GradeTopK *top;
+
+	if (k == 0 || k > GRADE_TOP_K_MAX)
+		return NULL;
+
+	top = climb_malloc(sizeof(GradeTopK) + k * sizeof(GradeTopKEntry));
+	top->k = k;
+	top->size = 0;
+
+	return top;
+}
+
+void grade_top_k_free(GradeTopK *top)
+{
+	climb_free(top);
+}
+
+void grade_top_k_add(GradeTopK *top, PackedGrade packed, double points)
+{
+	GradeTopKEntry entry = { packed, points };
+
+	if (top->size < top->k) {
+		top->entries[top->size] = entry;
+		top_k_sift_up(top, top->size++);
+	} else if (top_k_entry_cmp(&entry, &top->entries[0]) > 0) {
+		top->entries[0] = entry;
+		top_k_sift_down(top, 0);
+	}
+}
+
+void grade_top_k_combine(GradeTopK *top, const GradeTopK *other)
+{
+	for (uint32_t i = 0; i < other->size; i++)
+		grade_top_k_add(top, other->entries[i].grade, other->entries[i].points);
+}
+
+size_t grade_top_k_sorted(const GradeTopK *top, GradeTopKEntry *entries)
+{
+	memcpy(entries, top->entries, top->size * sizeof(GradeTopKEntry));
+	qsort(entries, top->size, sizeof(GradeTopKEntry), top_k_entry_sort_cmp);
+
+	return top->size;
+}
+
+static size_t top_k_entry_size(void)
+{
+	// type + value + points
+	return sizeof(uint8_t) + sizeof(uint8_t) + sizeof(double);
+}
+
+size_t grade_top_k_buffer_size(const GradeTopK *top)
+{
+	return 2 * sizeof(uint32_t) + top->size * top_k_entry_size();
+}
+
+size_t grade_top_k_buffer_write(const GradeTopK *top, uint8_t *buf)
+{
+	uint8_t *loc = buf;
+
+	loc += buffer_write_uint32_t(loc, top->k);
+	loc += buffer_write_uint32_t(loc, top->size);
+
+	for (uint32_t i = 0; i < top->size; i++) {
+		loc += buffer_write_uint8_t(loc, packed_grade_type(top->entries[i].grade));
+		loc += buffer_write_uint8_t(loc, packed_grade_value(top->entries[i].grade));
+		memcpy(loc, &top->entries[i].points, sizeof(double));
+		loc += sizeof(double);
+	}
+
+	return loc - buf;
+}
+
+GradeTopK *grade_top_k_from_buffer(const uint8_t *buf, size_t size)
+{
+	const uint8_t *loc = buf;
+	GradeTopK *top;
+	uint32_t k;
+	uint32_t entries;
+
+	if (size < 2 * sizeof(uint32_t))
+		return NULL;
+
+	memcpy(&k, loc, sizeof(uint32_t));
+	loc += sizeof(uint32_t);
+	memcpy(&entries, loc, sizeof(uint32_t));
+	loc += sizeof(uint32_t);
+
+	if (entries > k
+	    || (size - 2 * sizeof(uint32_t)) != entries * top_k_entry_size())
+		return NULL;
+
+	top = grade_top_k_create(k);
+
+	if (!top)
+		return NULL;
+
+	// the entries were written in heap order, so they are still a heap
+	for (uint32_t i = 0; i < entries; i++) {
+		if (!valid_type(loc[0])) {
+			grade_top_k_free(top);
+			return NULL;
+		}
+
+		top->entries[i].grade = packed_grade_make(loc[0], loc[1]);
+		memcpy(&top->entries[i].points, loc + 2 * sizeof(uint8_t), sizeof(double));
+		loc += top_k_entry_size();
+	}
+
+	top->size = entries;
+
+	return top;
+}
+
+// The easiest grade counted, which is what min is over a sliding window frame
+int grade_histogram_min(const GradeHistogram *histogram, PackedGrade *packed)
+{
+	for (int t = 0; t < GRADE_SCALES; t++) {
+		for (int v = 0; v <= UINT8_MAX; v++) {
+			if (histogram->counts[t][v] > 0) {
+				*packed = packed_grade_make(t + 1, v);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+// The hardest grade counted
+int grade_histogram_max(const GradeHistogram *histogram, PackedGrade *packed)
+{
+	for (int t = GRADE_SCALES - 1; t >= 0; t--) {
+		for (int v = UINT8_MAX; v >= 0; v--) {
+			if (histogram->counts[t][v] > 0) {
+				*packed = packed_grade_make(t + 1, v);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
@@ -10,6 +10,18 @@
 #define FONTTYPE	2
 #define YDSTYPE	3
 
+// Parse Errors - the reason a string isn't a grade. Parsing returns one of
+// these, so success is still 0 and every failure is nonzero.
+#define GRADE_PARSE_OK	0
+#define GRADE_PARSE_EMPTY	1
+#define GRADE_PARSE_UNKNOWN_SCALE	2
+#define GRADE_PARSE_SYNTAX	3
+#define GRADE_PARSE_OUT_OF_RANGE	4
+#define GRADE_PARSE_WRONG_SCALE	5
+
+// The longest formatted grade is "F46C+", 5 characters plus the terminator
+#define GRADE_STRING_SIZE	8
+
 // Data Structures
 typedef struct {
 	void *data;
@@ -31,28 +43,100 @@ typedef struct {
 	uint32_t type; /* GRADE_TYPE_YDS */
 } Yds;
 
-// This is a serialized grade. Some header data and flags can be added to the
-// structure to determine how it should be interpreted, but for now it's just
-// data. Here is how the data should be formatted.
+// This is a serialized grade. It starts with a header byte carrying the format
+// version, flags and type, followed by the grade's value. Here is how the data
+// should be formatted.
+//
+// [uint8_t header][uint8_t value]
+//
+// <header>
+// [1 bit, always set][3 bits version][2 bits flags][2 bits type]
 //
 // Open-ended, discrete scales (like the V-scale and Font-scale) are just
 // represented by a single integer despite appearinging like they contain more
 // than one component.
 //
-// <verm-type>
-// [uint8_t]
+// Grades serialized by 0.1 have no header, just a native-endian type word
+// before the value. The first byte of that word is never more than 3, so the
+// header's high bit tells the layouts apart and both are always readable.
 //
-// <font-type>
-// [uint8_t]
-//
-// <yds-type>
-// [uint8_t]
+// [uint32_t type][uint8_t value]
+#define SERIALIZED_GRADE_VERSION	1
+
 typedef struct {
 	char data[1];
 } SerializedGrade;
 
+// This is a packed grade, the fixed-length representation of a grade. It fits
+// in a single 32-bit word so that it can be passed by value.
+//
+// [uint8_t unused][uint8_t unused][uint8_t type][uint8_t value]
+//
+// The type is more significant than the value, so comparing two packed grades
+// as integers orders them the same way grade_cmp does.
+//
+// Outside of the server (binary COPY, the binary protocol) a packed grade is
+// written as the two bytes below, which leaves no byte order to agree on.
+//
+// [uint8_t type][uint8_t value]
+typedef uint32_t PackedGrade;
+
+// This is a histogram of grades, a count for every value of every scale. It is
+// a fixed size, so counting a grade is a single increment whatever the
+// distribution looks like. Counts are never negative.
+#define GRADE_SCALES	3
+
+typedef struct {
+	int64_t counts[GRADE_SCALES][UINT8_MAX + 1];
+} GradeHistogram;
+
+// A histogram is serialized as only the grades that were counted, in grade
+// order, so it is as small as the distribution it holds.
+//
+// [uint32_t entries]
+// <entry>...
+//
+// <entry>
+// [uint8_t type][uint8_t value][int64_t count]
+
+// This is a bounded heap of the hardest grades seen, for scoring the top k
+// ascents. It is a min heap, so the easiest of the kept ascents is at the root
+// and is the one that gets replaced. Ascents of the same grade are ranked by
+// their points.
+#define GRADE_TOP_K_MAX	10000
+
+typedef struct {
+	PackedGrade grade;
+	double points;
+} GradeTopKEntry;
+
+typedef struct {
+	uint32_t k;
+	uint32_t size;
+	GradeTopKEntry entries[];
+} GradeTopK;
+
+// A top k heap is serialized as its bound and its entries, in heap order.
+//
+// [uint32_t k][uint32_t size]
+// <entry>...
+//
+// <entry>
+// [uint8_t type][uint8_t value][double points]
+
+// Memory - everything the library returns is allocated, and should be freed,
+// through the allocator. It defaults to libc's malloc and free.
+typedef struct {
+	void *(*alloc)(size_t size);
+	void (*free)(void *ptr);
+} GradeAllocator;
+
+// Allocator Functions
+void grade_set_allocator(const GradeAllocator *allocator);
+
 // Type Functions
 const char *grade_type_name(uint32_t type);
+const char *grade_parse_error_message(int error);
 uint32_t grade_type_from_typmod(const char *);
 int typmod_string(char **, int32_t typmod);
 
@@ -109,10 +193,61 @@ Grade *grade_from_serialized_grade_data(uint8_t *buf);
 Verm *verm_from_serialized_grade_data(const uint8_t *buf, size_t *size);
 Font *font_from_serialized_grade_data(const uint8_t *buf, size_t *size);
 Yds *yds_from_serialized_grade_data(const uint8_t *buf, size_t *size);
+uint32_t serialized_grade_data_version(const uint8_t *buf);
+uint32_t serialized_grade_data_type(const uint8_t *buf);
 uint32_t serialized_grade_data_read_uint32_t(const uint8_t *buf);
 uint8_t serialized_grade_data_read_uint8_t(const uint8_t *data);
 size_t serialized_grade_buffer_write_verm(const Verm *verm, uint8_t *buf);
 size_t serialized_grade_buffer_write_font(const Font *font, uint8_t *buf);
 size_t serialized_grade_buffer_write_yds(const Yds *yds, uint8_t *buf);
+size_t serialized_grade_size_unversioned(void);
+size_t serialized_grade_buffer_write_unversioned(PackedGrade packed, uint8_t *buf);
+
+// Packing Functions
+PackedGrade packed_grade_make(uint32_t type, uint8_t value);
+uint32_t packed_grade_type(PackedGrade packed);
+uint8_t packed_grade_value(PackedGrade packed);
+PackedGrade packed_grade_from_grade(const Grade *grade);
+PackedGrade packed_grade_from_serialized(const SerializedGrade *serialized);
+Grade *grade_from_packed(PackedGrade packed);
+int packed_grade_cmp(PackedGrade p1, PackedGrade p2);
+int packed_grade_next(PackedGrade packed, PackedGrade *next);
+int32_t packed_grade_distance(PackedGrade p1, PackedGrade p2);
+size_t packed_grade_buffer_size(void);
+size_t packed_grade_buffer_write(PackedGrade packed, uint8_t *buf);
+PackedGrade packed_grade_from_buffer(const uint8_t *buf, size_t *size);
+int packed_grade_parse(const char *str, uint32_t type_hint, PackedGrade *packed);
+const char *packed_grade_string(PackedGrade packed, size_t *len);
+char *packed_grade_to_string(PackedGrade packed);
+
+// Histogram Functions
+GradeHistogram *grade_histogram_create(void);
+void grade_histogram_free(GradeHistogram *histogram);
+int grade_histogram_add(GradeHistogram *histogram, PackedGrade packed, int64_t count);
+int64_t grade_histogram_count(const GradeHistogram *histogram, PackedGrade packed);
+int grade_histogram_combine(GradeHistogram *histogram, const GradeHistogram *other);
+int grade_histogram_subtract(GradeHistogram *histogram, const GradeHistogram *other);
+size_t grade_histogram_buffer_size(const GradeHistogram *histogram);
+size_t grade_histogram_buffer_write(const GradeHistogram *histogram, uint8_t *buf);
+int grade_histogram_from_buffer(GradeHistogram *histogram, const uint8_t *buf, size_t size);
+int grade_histogram_parse(GradeHistogram *histogram, const char *str);
+char *grade_histogram_to_string(const GradeHistogram *histogram);
+int grade_histogram_percentile(const GradeHistogram *histogram, double fraction, PackedGrade *packed);
+int grade_histogram_mode(const GradeHistogram *histogram, PackedGrade *packed);
+int grade_histogram_min(const GradeHistogram *histogram, PackedGrade *packed);
+int grade_histogram_max(const GradeHistogram *histogram, PackedGrade *packed);
+
+// Top K Functions
+GradeTopK *grade_top_k_create(uint32_t k);
+void grade_top_k_free(GradeTopK *top);
+void grade_top_k_add(GradeTopK *top, PackedGrade packed, double points);
+void grade_top_k_combine(GradeTopK *top, const GradeTopK *other);
+size_t grade_top_k_sorted(const GradeTopK *top, GradeTopKEntry *entries);
+size_t grade_top_k_buffer_size(const GradeTopK *top);
+size_t grade_top_k_buffer_write(const GradeTopK *top, uint8_t *buf);
+GradeTopK *grade_top_k_from_buffer(const uint8_t *buf, size_t size);
+
+// Conversion Functions
+int packed_grade_convert(PackedGrade packed, uint32_t type, PackedGrade *converted);
 
 #endif
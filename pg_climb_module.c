@@ -1,150 +1,1367 @@
 #include <postgres.h>
 
 #include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
 #include "pg_climb.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/palloc.h"
 
 #include <catalog/pg_type_d.h>
+#include <common/hashfn.h>
 #include <fmgr.h>
+#include <nodes/nodeFuncs.h>
+#include <nodes/supportnodes.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <utils/array.h>
+#include <utils/lsyscache.h>
+#include <utils/rangetypes.h>
+#include <utils/sortsupport.h>
 #include <varatt.h>
 
 PG_MODULE_MAGIC;
 
+// allocate in the current memory context, so that whatever the library
+// allocates is released with it instead of growing the backend
+static const GradeAllocator palloc_allocator = { palloc, pfree };
+
+void
+_PG_init(void)
+{
+	grade_set_allocator(&palloc_allocator);
+}
+
 static inline SerializedGrade *
 DatumGetSergradeP(Datum X)
 {
-	return (SerializedGrade *) (DatumGetPointer(X) + VARHDRSZ);
+	return (SerializedGrade *) (DatumGetPointer(X) + VARHDRSZ);
+}
+static inline Datum
+SergradePGetDatum(const SerializedGrade *X)
+{
+	return PointerGetDatum(X);
+}
+#define PG_GETARG_SERGRADE_P(n) DatumGetSergradeP(PG_GETARG_DATUM(n))
+#define PG_RETURN_SERGRADE_P(x) return SergradePGetDatum(x)
+
+static inline PackedGrade
+DatumGetPackedGrade(Datum X)
+{
+	return (PackedGrade) DatumGetUInt32(X);
+}
+static inline Datum
+PackedGradeGetDatum(PackedGrade X)
+{
+	return UInt32GetDatum(X);
+}
+#define PG_GETARG_PACKEDGRADE(n) DatumGetPackedGrade(PG_GETARG_DATUM(n))
+#define PG_RETURN_PACKEDGRADE(x) return PackedGradeGetDatum(x)
+
+// Bulk loads parse the same few hundred grade strings over and over, so each
+// call site of grade_in keeps a small cache of the grades it has parsed. Grade
+// strings are short enough to be their own key.
+#define GRADE_IN_CACHE_SIZE	256
+
+typedef struct {
+	uint64	key;
+	int32	typmod;
+	PackedGrade	packed;
+} GradeInCacheEntry;
+
+// the first call only marks the call site, so a one-off call like parsing a
+// single literal doesn't pay for a cache it will never use
+static char grade_in_cache_pending;
+
+static GradeInCacheEntry *
+grade_in_cache(FmgrInfo *flinfo)
+{
+	if (flinfo == NULL)
+		return NULL;
+
+	if (flinfo->fn_extra == NULL) {
+		flinfo->fn_extra = &grade_in_cache_pending;
+		return NULL;
+	}
+
+	if (flinfo->fn_extra == &grade_in_cache_pending)
+		flinfo->fn_extra = MemoryContextAllocZero(flinfo->fn_mcxt,
+			GRADE_IN_CACHE_SIZE * sizeof(GradeInCacheEntry));
+
+	return (GradeInCacheEntry *) flinfo->fn_extra;
+}
+
+// the packed grade's entry points are PACKED_GRADE_*, because the GRADE_*
+// names still back the variable-length grade of 0.1, see the legacy
+// entry points below
+PG_FUNCTION_INFO_V1(PACKED_GRADE_in);
+
+Datum
+PACKED_GRADE_in(PG_FUNCTION_ARGS)
+{
+	PackedGrade	packed;
+	char	*input = PG_GETARG_CSTRING(0);
+	int32_t	typmod = -1;
+	GradeInCacheEntry	*cache;
+	GradeInCacheEntry	*entry = NULL;
+	uint64	key = 0;
+	size_t	len;
+	int	error;
+
+	if (PG_NARGS() > 2 && !PG_ARGISNULL(2)) {
+		typmod = PG_GETARG_INT32(2);
+	}
+
+	// the key is the string and its terminator, zero padded, so only strings
+	// shorter than the key are cached, and never the empty string that would
+	// match an unused entry
+	len = strnlen(input, sizeof(key));
+
+	if (len > 0 && len < sizeof(key) && (cache = grade_in_cache(fcinfo->flinfo)) != NULL) {
+		memcpy(&key, input, len);
+		entry = &cache[murmurhash64(key) & (GRADE_IN_CACHE_SIZE - 1)];
+
+		if (entry->key == key && entry->typmod == typmod)
+			PG_RETURN_PACKEDGRADE(entry->packed);
+	}
+
+	// report through the soft error context when there is one, so COPY's
+	// ON_ERROR and pg_input_is_valid can skip a bad grade
+	error = packed_grade_parse(input, typmod < 0 ? ANYTYPE : (uint32_t)typmod, &packed);
+
+	if (error != GRADE_PARSE_OK)
+		ereturn(fcinfo->context, (Datum) 0,
+				(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+				 errmsg("parse error - invalid grade"),
+				 errdetail("%s", grade_parse_error_message(error))));
+
+	if (entry) {
+		entry->key = key;
+		entry->typmod = typmod;
+		entry->packed = packed;
+	}
+
+	PG_RETURN_PACKEDGRADE(packed);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_out);
+
+Datum
+PACKED_GRADE_out(PG_FUNCTION_ARGS)
+{
+	PackedGrade	packed = PG_GETARG_PACKEDGRADE(0);
+	const char	*str;
+	size_t	len;
+
+	str = packed_grade_string(packed, &len);
+
+	if (!str)
+		ereport(ERROR,(errmsg("Failed to unpack grade data")));
+
+	PG_RETURN_CSTRING(pnstrdup(str, len));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_recv);
+
+Datum
+GRADE_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo	buf = (StringInfo) PG_GETARG_POINTER(0);
+	PackedGrade	packed;
+	int32_t	typmod = -1;
+	uint32_t	type;
+
+	if (PG_NARGS() > 2 && !PG_ARGISNULL(2)) {
+		typmod = PG_GETARG_INT32(2);
+	}
+
+	packed = packed_grade_from_buffer(
+		(const uint8_t *)pq_getmsgbytes(buf, packed_grade_buffer_size()), NULL);
+	type = packed_grade_type(packed);
+
+	if (type != VERMTYPE && type != FONTTYPE && type != YDSTYPE)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				 errmsg("invalid grade type in external binary representation")));
+
+	if (typmod >= 0 && typmod != type)
+		ereport(ERROR, errmsg("typmod mismatched"));
+
+	PG_RETURN_PACKEDGRADE(packed);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_send);
+
+Datum
+GRADE_send(PG_FUNCTION_ARGS)
+{
+	PackedGrade	packed = PG_GETARG_PACKEDGRADE(0);
+	StringInfoData	buf;
+	uint8_t	data[2];
+	size_t	size;
+
+	size = packed_grade_buffer_write(packed, data);
+	Assert(size <= sizeof(data));
+
+	pq_begintypsend(&buf);
+	pq_sendbytes(&buf, data, size);
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_typmod_in);
+
+Datum
+GRADE_typmod_in(PG_FUNCTION_ARGS)
+{
+	ArrayType	*arr = (ArrayType *) DatumGetPointer(PG_GETARG_DATUM(0));
+	Datum	*values;
+	const char	*str;
+	int	size;
+	uint32_t	typmod;
+
+	deconstruct_array(arr, CSTRINGOID, -2, false, 'c', &values, NULL, &size);
+
+	if (size != 1)
+		ereturn(fcinfo->context, (Datum) 0,
+				(errcode(ERRCODE_DATA_EXCEPTION),
+				 errmsg("typmod array must contain exactly one value")));
+
+	str = DatumGetCString(values[0]);
+	typmod = grade_type_from_typmod(str);
+
+	if (typmod == ANYTYPE)
+		ereturn(fcinfo->context, (Datum) 0,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("parameter value not a valid typmod")));
+
+	PG_RETURN_INT32(typmod);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_typmod_out);
+
+Datum
+GRADE_typmod_out(PG_FUNCTION_ARGS)
+{
+	StringInfoData	si;
+	char	*typmod_str;
+	int32_t	typmod = PG_GETARG_INT32(0);
+
+	if (typmod < 0)
+		PG_RETURN_CSTRING(pstrdup(""));
+
+	initStringInfo(&si);
+	appendStringInfoChar(&si, '(');
+
+	if (typmod_string(&typmod_str, typmod) != 0) {
+		ereport(WARNING, (errmsg("failed to stringify typmod")));
+		typmod_str = psprintf("%d", typmod);
+	}
+
+	appendStringInfoString(&si, typmod_str);
+	appendStringInfoChar(&si, ')');
+
+	pfree(typmod_str);
+
+	PG_RETURN_CSTRING(si.data);
+}
+
+static PackedGrade
+convert_grade(PackedGrade packed, uint32_t type)
+{
+	PackedGrade converted;
+	const char *str;
+
+	if (packed_grade_convert(packed, type, &converted) != 0) {
+		str = packed_grade_string(packed, NULL);
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("grade \"%s\" has no %s equivalent",
+						str ? str : "", grade_type_name(type))));
+	}
+
+	return converted;
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_enforce_typmod);
+
+Datum
+PACKED_GRADE_enforce_typmod(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed = PG_GETARG_PACKEDGRADE(0);
+	int32_t typmod = PG_GETARG_INT32(1);
+	bool is_explicit = PG_GETARG_BOOL(2);
+
+	if (typmod == packed_grade_type(packed))
+		PG_RETURN_PACKEDGRADE(packed);
+
+	// like casting to a shorter varchar truncates, an explicit cast converts
+	// the grade to the scale, but assigning a grade of another scale is
+	// still an error
+	if (!is_explicit)
+		ereport(ERROR, errmsg("typmod mismatched"));
+
+	PG_RETURN_PACKEDGRADE(convert_grade(packed, typmod));
+}
+
+// Planner support for the typmod cast, like varchar's. When the grade already
+// has the typmod, or the typmod is dropped, the cast can't change or reject
+// the grade, so it is replaced with a relabel. That also lets ALTER TABLE skip
+// rewriting a table whose grades keep their scale.
+PG_FUNCTION_INFO_V1(GRADE_support);
+
+Datum
+GRADE_support(PG_FUNCTION_ARGS)
+{
+	Node *rawreq = (Node *) PG_GETARG_POINTER(0);
+	Node *ret = NULL;
+
+	if (IsA(rawreq, SupportRequestSimplify)) {
+		SupportRequestSimplify *req = (SupportRequestSimplify *) rawreq;
+		FuncExpr *expr = req->fcall;
+		Node *typmod;
+
+		Assert(list_length(expr->args) >= 2);
+
+		typmod = (Node *) lsecond(expr->args);
+
+		if (IsA(typmod, Const) && !((Const *) typmod)->constisnull) {
+			Node *source = (Node *) linitial(expr->args);
+			int32 old_typmod = exprTypmod(source);
+			int32 new_typmod = DatumGetInt32(((Const *) typmod)->constvalue);
+
+			if (new_typmod < 0 || old_typmod == new_typmod)
+				ret = relabel_to_typmod(source, new_typmod);
+		}
+	}
+
+	PG_RETURN_POINTER(ret);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_convert);
+
+Datum
+GRADE_convert(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed = PG_GETARG_PACKEDGRADE(0);
+	char *scale = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	uint32_t type;
+
+	type = grade_type_from_typmod(scale);
+
+	if (type == ANYTYPE)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("\"%s\" is not a grade scale", scale)));
+
+	pfree(scale);
+
+	PG_RETURN_PACKEDGRADE(convert_grade(packed, type));
+}
+
+// parses a whole text[] into a grade[], writing the grades straight into the
+// result array rather than building a datum for each element first
+PG_FUNCTION_INFO_V1(GRADE_parse_array);
+
+Datum
+GRADE_parse_array(PG_FUNCTION_ARGS)
+{
+	ArrayType *input = PG_GETARG_ARRAYTYPE_P(0);
+	char *scale = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	ArrayType *result;
+	PackedGrade *data;
+	Datum *values;
+	bool *nulls;
+	bits8 *bitmap;
+	Oid element_type;
+	uint32_t type = ANYTYPE;
+	int count;
+	int grades = 0;
+	int error;
+	Size offset;
+	Size size;
+	char buf[GRADE_STRING_SIZE * 2];
+
+	if (pg_strcasecmp(scale, "any") != 0) {
+		type = grade_type_from_typmod(scale);
+
+		if (type == ANYTYPE)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("\"%s\" is not a grade scale", scale)));
+	}
+
+	pfree(scale);
+
+	if (ARR_NDIM(input) > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("multidimensional arrays of grades are not supported")));
+
+	element_type = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+
+	if (!OidIsValid(element_type))
+		elog(ERROR, "could not determine grade array type");
+
+	deconstruct_array(input, TEXTOID, -1, false, TYPALIGN_INT, &values, &nulls, &count);
+
+	if (count == 0)
+		PG_RETURN_ARRAYTYPE_P(construct_empty_array(element_type));
+
+	for (int i = 0; i < count; i++)
+		grades += !nulls[i];
+
+	offset = ARR_HASNULL(input) ? ARR_OVERHEAD_WITHNULLS(1, count) : ARR_OVERHEAD_NONULLS(1);
+	size = offset + grades * sizeof(PackedGrade);
+
+	result = palloc0(size);
+	SET_VARSIZE(result, size);
+	result->ndim = 1;
+	result->dataoffset = ARR_HASNULL(input) ? offset : 0;
+	result->elemtype = element_type;
+	ARR_DIMS(result)[0] = count;
+	ARR_LBOUND(result)[0] = ARR_LBOUND(input)[0];
+
+	bitmap = ARR_NULLBITMAP(result);
+	data = (PackedGrade *) ARR_DATA_PTR(result);
+
+	for (int i = 0; i < count; i++) {
+		text *element;
+		char *str;
+		size_t len;
+
+		// a cleared bit in the zeroed bitmap is already a null
+		if (nulls[i])
+			continue;
+
+		if (bitmap)
+			bitmap[i / 8] |= 1 << (i % 8);
+
+		element = (text *) DatumGetPointer(values[i]);
+		len = VARSIZE_ANY_EXHDR(element);
+
+		// only grades with padded numbers are ever this long
+		str = len < sizeof(buf) ? buf : palloc(len + 1);
+		memcpy(str, VARDATA_ANY(element), len);
+		str[len] = '\0';
+
+		error = packed_grade_parse(str, type, data);
+
+		if (error != GRADE_PARSE_OK)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+					 errmsg("invalid grade \"%s\" at index %d",
+							str, ARR_LBOUND(input)[0] + i),
+					 errdetail("%s", grade_parse_error_message(error))));
+
+		if (str != buf)
+			pfree(str);
+
+		data++;
+	}
+
+	pfree(values);
+	pfree(nulls);
+
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_lt);
+
+Datum
+PACKED_GRADE_lt(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_BOOL(packed_grade_cmp(g1, g2) < 0);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_le);
+
+Datum
+PACKED_GRADE_le(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_BOOL(packed_grade_cmp(g1, g2) <= 0);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_eq);
+
+Datum
+PACKED_GRADE_eq(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_BOOL(packed_grade_cmp(g1, g2) == 0);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_neq);
+
+Datum
+PACKED_GRADE_neq(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_BOOL(packed_grade_cmp(g1, g2) != 0);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_ge);
+
+Datum
+PACKED_GRADE_ge(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_BOOL(packed_grade_cmp(g1, g2) >= 0);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_gt);
+
+Datum
+PACKED_GRADE_gt(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_BOOL(packed_grade_cmp(g1, g2) > 0);
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_cmp);
+
+Datum
+PACKED_GRADE_cmp(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_INT32(packed_grade_cmp(g1, g2));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_larger);
+
+Datum
+GRADE_larger(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_PACKEDGRADE(packed_grade_cmp(g1, g2) >= 0 ? g1 : g2);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_smaller);
+
+Datum
+GRADE_smaller(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_PACKEDGRADE(packed_grade_cmp(g1, g2) <= 0 ? g1 : g2);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_sortsupport);
+
+Datum
+GRADE_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	// packed grades order as plain integers, which lets tuplesort use its
+	// specialized integer sort. Being passed by value, there is nothing to
+	// abbreviate.
+	ssup->comparator = ssup_datum_int32_cmp;
+
+	PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(GRADE_hash);
+
+Datum
+GRADE_hash(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed = PG_GETARG_PACKEDGRADE(0);
+
+	// hash only the type and value, equal grades must hash equally
+	return hash_uint32(packed_grade_make(packed_grade_type(packed),
+					     packed_grade_value(packed)));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_hash_extended);
+
+Datum
+GRADE_hash_extended(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed = PG_GETARG_PACKEDGRADE(0);
+	uint64 seed = PG_GETARG_INT64(1);
+
+	return hash_uint32_extended(packed_grade_make(packed_grade_type(packed),
+						      packed_grade_value(packed)),
+				    seed);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_range_canonical);
+
+Datum
+GRADE_range_canonical(PG_FUNCTION_ARGS)
+{
+	RangeType *range = PG_GETARG_RANGE_P(0);
+	TypeCacheEntry *typcache;
+	RangeBound lower;
+	RangeBound upper;
+	PackedGrade next;
+	bool empty;
+
+	typcache = range_get_typcache(fcinfo, RangeTypeGetOid(range));
+	range_deserialize(typcache, range, &lower, &upper, &empty);
+
+	if (empty)
+		PG_RETURN_RANGE_P(range);
+
+	// grades are discrete, so like int4range every range is normalized to
+	// an inclusive lower and exclusive upper bound
+	if (!lower.infinite && !lower.inclusive) {
+		if (packed_grade_next(DatumGetPackedGrade(lower.val), &next) != 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("grade out of range")));
+
+		lower.val = PackedGradeGetDatum(next);
+		lower.inclusive = true;
+	}
+
+	if (!upper.infinite && upper.inclusive) {
+		if (packed_grade_next(DatumGetPackedGrade(upper.val), &next) != 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATA_EXCEPTION),
+					 errmsg("grade out of range")));
+
+		upper.val = PackedGradeGetDatum(next);
+		upper.inclusive = false;
+	}
+
+	PG_RETURN_RANGE_P(range_serialize(typcache, &lower, &upper, false, NULL));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_range_subdiff);
+
+Datum
+GRADE_range_subdiff(PG_FUNCTION_ARGS)
+{
+	PackedGrade g1 = PG_GETARG_PACKEDGRADE(0);
+	PackedGrade g2 = PG_GETARG_PACKEDGRADE(1);
+
+	// used by GiST to size ranges, the distance in grades is enough
+	PG_RETURN_FLOAT8((float8) packed_grade_distance(g1, g2));
+}
+
+PG_FUNCTION_INFO_V1(PACKED_GRADE_type);
+
+Datum
+PACKED_GRADE_type(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed = PG_GETARG_PACKEDGRADE(0);
+	char *type_str;
+	text *type_text;
+
+	// NOTE Grade.type _is_ typmod for valid types (for now)
+	if (typmod_string(&type_str, packed_grade_type(packed)) == 0) {
+		type_text = cstring_to_text(type_str);
+		pfree(type_str);
+	} else {
+		type_text = cstring_to_text("");
+	}
+
+	PG_RETURN_TEXT_P(type_text);
+}
+
+// A grade_histogram is stored as a serialized GradeHistogram, and it is the
+// result of the grade_histogram aggregate, whose state is the GradeHistogram
+// itself.
+
+static GradeHistogram *
+histogram_from_varlena(const bytea *bytes)
+{
+	GradeHistogram *histogram = grade_histogram_create();
+
+	if (grade_histogram_from_buffer(histogram, (const uint8_t *) VARDATA_ANY(bytes),
+					VARSIZE_ANY_EXHDR(bytes)) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid grade histogram data")));
+
+	return histogram;
+}
+
+static bytea *
+histogram_to_varlena(const GradeHistogram *histogram)
+{
+	size_t size = grade_histogram_buffer_size(histogram);
+	bytea *bytes = palloc(size + VARHDRSZ);
+
+	grade_histogram_buffer_write(histogram, (uint8_t *) VARDATA(bytes));
+	SET_VARSIZE(bytes, size + VARHDRSZ);
+
+	return bytes;
+}
+
+static void
+histogram_overflow(void)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+			 errmsg("grade histogram count out of range")));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_in);
+
+Datum
+GRADE_histogram_in(PG_FUNCTION_ARGS)
+{
+	char *input = PG_GETARG_CSTRING(0);
+	GradeHistogram *histogram = grade_histogram_create();
+
+	if (grade_histogram_parse(histogram, input) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+				 errmsg("parse error - invalid grade histogram")));
+
+	PG_RETURN_BYTEA_P(histogram_to_varlena(histogram));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_out);
+
+Datum
+GRADE_histogram_out(PG_FUNCTION_ARGS)
+{
+	GradeHistogram *histogram = histogram_from_varlena(PG_GETARG_BYTEA_PP(0));
+
+	PG_RETURN_CSTRING(grade_histogram_to_string(histogram));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_recv);
+
+Datum
+GRADE_histogram_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo	buf = (StringInfo) PG_GETARG_POINTER(0);
+	GradeHistogram	*histogram = grade_histogram_create();
+	int	size = buf->len - buf->cursor;
+
+	// the external binary representation is the serialized GradeHistogram
+	if (grade_histogram_from_buffer(histogram,
+					(const uint8_t *)pq_getmsgbytes(buf, size), size) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				 errmsg("invalid grade histogram in external binary representation")));
+
+	PG_RETURN_BYTEA_P(histogram_to_varlena(histogram));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_send);
+
+Datum
+GRADE_histogram_send(PG_FUNCTION_ARGS)
+{
+	GradeHistogram	*histogram = histogram_from_varlena(PG_GETARG_BYTEA_PP(0));
+	StringInfoData	buf;
+	size_t	size = grade_histogram_buffer_size(histogram);
+	uint8_t	*data = palloc(size);
+
+	grade_histogram_buffer_write(histogram, data);
+
+	pq_begintypsend(&buf);
+	pq_sendbytes(&buf, data, size);
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_add);
+
+Datum
+GRADE_histogram_add(PG_FUNCTION_ARGS)
+{
+	GradeHistogram *h1 = histogram_from_varlena(PG_GETARG_BYTEA_PP(0));
+	GradeHistogram *h2 = histogram_from_varlena(PG_GETARG_BYTEA_PP(1));
+
+	if (grade_histogram_combine(h1, h2) != 0)
+		histogram_overflow();
+
+	PG_RETURN_BYTEA_P(histogram_to_varlena(h1));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_subtract);
+
+Datum
+GRADE_histogram_subtract(PG_FUNCTION_ARGS)
+{
+	GradeHistogram *h1 = histogram_from_varlena(PG_GETARG_BYTEA_PP(0));
+	GradeHistogram *h2 = histogram_from_varlena(PG_GETARG_BYTEA_PP(1));
+
+	if (grade_histogram_subtract(h1, h2) != 0)
+		histogram_overflow();
+
+	PG_RETURN_BYTEA_P(histogram_to_varlena(h1));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_count);
+
+Datum
+GRADE_histogram_count(PG_FUNCTION_ARGS)
+{
+	GradeHistogram *histogram = histogram_from_varlena(PG_GETARG_BYTEA_PP(0));
+	PackedGrade packed = PG_GETARG_PACKEDGRADE(1);
+
+	PG_RETURN_INT64(grade_histogram_count(histogram, packed));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_transfn);
+
+Datum
+GRADE_histogram_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	GradeHistogram *state;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "grade_histogram_transfn called in non-aggregate context");
+
+	if (PG_ARGISNULL(0)) {
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		state = grade_histogram_create();
+		MemoryContextSwitchTo(oldcontext);
+	} else {
+		state = (GradeHistogram *) PG_GETARG_POINTER(0);
+	}
+
+	if (!PG_ARGISNULL(1)
+	    && grade_histogram_add(state, PG_GETARG_PACKEDGRADE(1), 1) != 0)
+		histogram_overflow();
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_inv_transfn);
+
+Datum
+GRADE_histogram_inv_transfn(PG_FUNCTION_ARGS)
+{
+	GradeHistogram *state;
+
+	// a grade leaving the window frame is uncounted, so moving the frame
+	// never recounts the grades still in it
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "grade_histogram_inv_transfn called with no state");
+
+	state = (GradeHistogram *) PG_GETARG_POINTER(0);
+
+	if (!PG_ARGISNULL(1)
+	    && grade_histogram_add(state, PG_GETARG_PACKEDGRADE(1), -1) != 0)
+		histogram_overflow();
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_combinefn);
+
+Datum
+GRADE_histogram_combinefn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	GradeHistogram *state;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "grade_histogram_combinefn called in non-aggregate context");
+
+	if (PG_ARGISNULL(1)) {
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	if (PG_ARGISNULL(0)) {
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		state = grade_histogram_create();
+		MemoryContextSwitchTo(oldcontext);
+	} else {
+		state = (GradeHistogram *) PG_GETARG_POINTER(0);
+	}
+
+	if (grade_histogram_combine(state, (GradeHistogram *) PG_GETARG_POINTER(1)) != 0)
+		histogram_overflow();
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_serialfn);
+
+Datum
+GRADE_histogram_serialfn(PG_FUNCTION_ARGS)
+{
+	GradeHistogram *state = (GradeHistogram *) PG_GETARG_POINTER(0);
+
+	// the state is mostly zeros, so send only the counted grades
+	PG_RETURN_BYTEA_P(histogram_to_varlena(state));
 }
-static inline Datum
-SergradePGetDatum(const SerializedGrade *X)
+
+PG_FUNCTION_INFO_V1(GRADE_histogram_deserialfn);
+
+Datum
+GRADE_histogram_deserialfn(PG_FUNCTION_ARGS)
 {
-	return PointerGetDatum(X);
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	GradeHistogram *state;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "grade_histogram_deserialfn called in non-aggregate context");
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+	state = histogram_from_varlena(PG_GETARG_BYTEA_PP(0));
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_POINTER(state);
 }
-#define PG_GETARG_SERGRADE_P(n) DatumGetSergradeP(PG_GETARG_DATUM(n))
-#define PG_RETURN_SERGRADE_P(x) return SergradePGetDatum(x)
 
-PG_FUNCTION_INFO_V1(GRADE_in);
+PG_FUNCTION_INFO_V1(GRADE_histogram_finalfn);
 
 Datum
-GRADE_in(PG_FUNCTION_ARGS)
+GRADE_histogram_finalfn(PG_FUNCTION_ARGS)
 {
-	Grade	*grade;
-	SerializedGrade	*serialized = NULL;
-	char	*input = PG_GETARG_CSTRING(0);
-	int32_t	typmod = -1;
-	size_t	size;
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
 
-	if (PG_NARGS() > 2 && !PG_ARGISNULL(2)) {
-		typmod = PG_GETARG_INT32(2);
-	}
+	PG_RETURN_BYTEA_P(histogram_to_varlena((GradeHistogram *) PG_GETARG_POINTER(0)));
+}
 
-	if (input[0] == '\0') {
-		ereport(ERROR,(errmsg("parse error - invalid grade")));
+PG_FUNCTION_INFO_V1(GRADE_histogram_min_final);
+
+Datum
+GRADE_histogram_min_final(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed;
+
+	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
-	}
 
-	grade = grade_from_string(input, typmod < 0 ? ANYTYPE : (uint32_t)typmod);
+	if (grade_histogram_min((GradeHistogram *) PG_GETARG_POINTER(0), &packed) != 0)
+		PG_RETURN_NULL();
 
-	if (grade) {
-		serialized = serialized_grade_from_grade(grade, &size);
+	PG_RETURN_PACKEDGRADE(packed);
+}
 
-		// insert postgres size header
-		serialized = realloc(serialized, size + VARHDRSZ);
-		memmove((uint8_t*)serialized + VARHDRSZ, serialized, size);
-		SET_VARSIZE(serialized, size + VARHDRSZ);
+PG_FUNCTION_INFO_V1(GRADE_histogram_max_final);
 
-		grade_free(grade);
-	} else {
-		ereport(ERROR,(errmsg("parse error - invalid grade")));
+Datum
+GRADE_histogram_max_final(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed;
+
+	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
-	}
 
-	PG_RETURN_SERGRADE_P(serialized);
+	if (grade_histogram_max((GradeHistogram *) PG_GETARG_POINTER(0), &packed) != 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_PACKEDGRADE(packed);
 }
 
-PG_FUNCTION_INFO_V1(GRADE_out);
+// percentile_disc and mode for grade share the grade_histogram state, so
+// rather than sorting every grade they count them and walk the counts
+
+static void
+check_percentile(float8 percentile)
+{
+	if (!(percentile >= 0 && percentile <= 1))
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("percentile value %g is not between 0 and 1", percentile)));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_percentile_disc_final);
 
 Datum
-GRADE_out(PG_FUNCTION_ARGS)
+GRADE_percentile_disc_final(PG_FUNCTION_ARGS)
 {
-	SerializedGrade	*serialized = PG_GETARG_SERGRADE_P(0);
-	// TODO is this leaky?
-	Grade *grade = grade_from_serialized(serialized);
+	GradeHistogram *state;
+	PackedGrade packed;
+	float8 percentile;
 
-	if (!grade)
-		ereport(ERROR,(errmsg("Failed to deserialized grade data")));
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		PG_RETURN_NULL();
+
+	state = (GradeHistogram *) PG_GETARG_POINTER(0);
+	percentile = PG_GETARG_FLOAT8(1);
+	check_percentile(percentile);
+
+	// only nulls were aggregated
+	if (grade_histogram_percentile(state, percentile, &packed) != 0)
+		PG_RETURN_NULL();
 
-	// TODO would it be a better API to allocate the string here and just
-	// format it?
-	PG_RETURN_CSTRING(grade_to_string(grade));
+	PG_RETURN_PACKEDGRADE(packed);
 }
 
-PG_FUNCTION_INFO_V1(GRADE_typmod_in);
+PG_FUNCTION_INFO_V1(GRADE_percentile_disc_multi_final);
 
 Datum
-GRADE_typmod_in(PG_FUNCTION_ARGS)
+GRADE_percentile_disc_multi_final(PG_FUNCTION_ARGS)
 {
-	ArrayType	*arr = (ArrayType *) DatumGetPointer(PG_GETARG_DATUM(0));
-	Datum	*values;
-	const char	*str;
-	int	size;
-	uint32_t	typmod;
+	GradeHistogram *state;
+	ArrayType *percentiles;
+	PackedGrade packed;
+	Datum *values;
+	Datum *result;
+	bool *nulls;
+	bool *result_nulls;
+	Oid element_type;
+	int size;
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		PG_RETURN_NULL();
 
-	deconstruct_array(arr, CSTRINGOID, -2, false, 'c', &values, NULL, &size);
+	state = (GradeHistogram *) PG_GETARG_POINTER(0);
+	percentiles = PG_GETARG_ARRAYTYPE_P(1);
 
-	if (size != 1) {
-		ereport(ERROR,
-				(errcode(ERRCODE_DATA_EXCEPTION),
-				 errmsg("typmod array must contain exactly one value")));
-		PG_RETURN_INT32(0);
+	element_type = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+
+	if (!OidIsValid(element_type))
+		elog(ERROR, "could not determine grade array type");
+
+	deconstruct_array(percentiles, FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL,
+					  TYPALIGN_DOUBLE, &values, &nulls, &size);
+
+	result = palloc(size * sizeof(Datum));
+	result_nulls = palloc(size * sizeof(bool));
+
+	for (int i = 0; i < size; i++) {
+		result_nulls[i] = nulls[i];
+
+		if (nulls[i])
+			continue;
+
+		check_percentile(DatumGetFloat8(values[i]));
+
+		if (grade_histogram_percentile(state, DatumGetFloat8(values[i]), &packed) != 0)
+			PG_RETURN_NULL();
+
+		result[i] = PackedGradeGetDatum(packed);
 	}
 
-	str = DatumGetCString(values[0]);
-	typmod = grade_type_from_typmod(str);
+	PG_RETURN_ARRAYTYPE_P(construct_md_array(result, result_nulls,
+						 ARR_NDIM(percentiles),
+						 ARR_DIMS(percentiles),
+						 ARR_LBOUND(percentiles),
+						 element_type, sizeof(PackedGrade),
+						 true, TYPALIGN_INT));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_mode_final);
+
+Datum
+GRADE_mode_final(PG_FUNCTION_ARGS)
+{
+	PackedGrade packed;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	if (grade_histogram_mode((GradeHistogram *) PG_GETARG_POINTER(0), &packed) != 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_PACKEDGRADE(packed);
+}
+
+// grade_top_k and grade_top_k_points keep the k hardest ascents of each group
+// in a GradeTopK, rather than sorting every ascent to take the first k
+
+static GradeTopK *
+top_k_state(FunctionCallInfo fcinfo, int k_arg)
+{
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	GradeTopK *state;
+	int32 k;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "grade_top_k transition function called in non-aggregate context");
+
+	if (!PG_ARGISNULL(0))
+		return (GradeTopK *) PG_GETARG_POINTER(0);
+
+	if (PG_ARGISNULL(k_arg))
+		return NULL;
 
-	if (typmod == ANYTYPE) {
+	k = PG_GETARG_INT32(k_arg);
+
+	if (k < 1 || k > GRADE_TOP_K_MAX)
 		ereport(ERROR,
 				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				 errmsg("parameter value not a valid typmod")));
-		PG_RETURN_INT32(0);
+				 errmsg("k must be between 1 and %d", GRADE_TOP_K_MAX)));
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+	state = grade_top_k_create(k);
+	MemoryContextSwitchTo(oldcontext);
+
+	return state;
+}
+
+PG_FUNCTION_INFO_V1(GRADE_top_k_transfn);
+
+Datum
+GRADE_top_k_transfn(PG_FUNCTION_ARGS)
+{
+	GradeTopK *state = top_k_state(fcinfo, 2);
+
+	if (!state)
+		PG_RETURN_NULL();
+
+	if (!PG_ARGISNULL(1))
+		grade_top_k_add(state, PG_GETARG_PACKEDGRADE(1), 0);
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_top_k_points_transfn);
+
+Datum
+GRADE_top_k_points_transfn(PG_FUNCTION_ARGS)
+{
+	GradeTopK *state = top_k_state(fcinfo, 3);
+
+	if (!state)
+		PG_RETURN_NULL();
+
+	if (!PG_ARGISNULL(1))
+		grade_top_k_add(state, PG_GETARG_PACKEDGRADE(1),
+				PG_ARGISNULL(2) ? 0 : PG_GETARG_FLOAT8(2));
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_top_k_combinefn);
+
+Datum
+GRADE_top_k_combinefn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	GradeTopK *state;
+	GradeTopK *other;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "grade_top_k_combinefn called in non-aggregate context");
+
+	if (PG_ARGISNULL(1)) {
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
 	}
 
-	PG_RETURN_INT32(typmod);
+	other = (GradeTopK *) PG_GETARG_POINTER(1);
+
+	if (PG_ARGISNULL(0)) {
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		state = grade_top_k_create(other->k);
+		MemoryContextSwitchTo(oldcontext);
+	} else {
+		state = (GradeTopK *) PG_GETARG_POINTER(0);
+	}
+
+	grade_top_k_combine(state, other);
+
+	PG_RETURN_POINTER(state);
 }
 
-PG_FUNCTION_INFO_V1(GRADE_typmod_out);
+PG_FUNCTION_INFO_V1(GRADE_top_k_serialfn);
 
 Datum
-GRADE_typmod_out(PG_FUNCTION_ARGS)
+GRADE_top_k_serialfn(PG_FUNCTION_ARGS)
 {
-	StringInfoData	si;
-	char	*typmod_str;
-	int32_t	typmod = PG_GETARG_INT32(0);
+	GradeTopK *state = (GradeTopK *) PG_GETARG_POINTER(0);
+	size_t size = grade_top_k_buffer_size(state);
+	bytea *bytes = palloc(size + VARHDRSZ);
 
-	if (typmod < 0)
-		PG_RETURN_CSTRING(pstrdup(""));
+	grade_top_k_buffer_write(state, (uint8_t *) VARDATA(bytes));
+	SET_VARSIZE(bytes, size + VARHDRSZ);
 
-	initStringInfo(&si);
-	appendStringInfoChar(&si, '(');
+	PG_RETURN_BYTEA_P(bytes);
+}
 
-	if (typmod_string(&typmod_str, typmod) != 0) {
-		ereport(WARNING, (errmsg("failed to stringify typmod")));
-		typmod_str = malloc(12); // enough
-		sprintf(typmod_str, "%d", typmod);
+PG_FUNCTION_INFO_V1(GRADE_top_k_deserialfn);
+
+Datum
+GRADE_top_k_deserialfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	MemoryContext oldcontext;
+	GradeTopK *state;
+	bytea *bytes = PG_GETARG_BYTEA_PP(0);
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "grade_top_k_deserialfn called in non-aggregate context");
+
+	oldcontext = MemoryContextSwitchTo(aggcontext);
+	state = grade_top_k_from_buffer((const uint8_t *) VARDATA_ANY(bytes),
+					VARSIZE_ANY_EXHDR(bytes));
+	MemoryContextSwitchTo(oldcontext);
+
+	if (!state)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid grade top k data")));
+
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_top_k_finalfn);
+
+Datum
+GRADE_top_k_finalfn(PG_FUNCTION_ARGS)
+{
+	GradeTopK *state;
+	GradeTopKEntry *entries;
+	Datum *grades;
+	Oid element_type;
+	size_t size;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (GradeTopK *) PG_GETARG_POINTER(0);
+	element_type = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+
+	if (!OidIsValid(element_type))
+		elog(ERROR, "could not determine grade array type");
+
+	entries = palloc(state->k * sizeof(GradeTopKEntry));
+	grades = palloc(state->k * sizeof(Datum));
+	size = grade_top_k_sorted(state, entries);
+
+	for (size_t i = 0; i < size; i++)
+		grades[i] = PackedGradeGetDatum(entries[i].grade);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(grades, size, element_type,
+					      sizeof(PackedGrade), true, TYPALIGN_INT));
+}
+
+PG_FUNCTION_INFO_V1(GRADE_top_k_points_finalfn);
+
+Datum
+GRADE_top_k_points_finalfn(PG_FUNCTION_ARGS)
+{
+	GradeTopK *state;
+	float8 points = 0;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (GradeTopK *) PG_GETARG_POINTER(0);
+
+	for (uint32_t i = 0; i < state->size; i++)
+		points += state->entries[i].points;
+
+	PG_RETURN_FLOAT8(points);
+}
+
+// Before 0.2 grades were stored as a variable-length SerializedGrade. These
+// entry points back the legacy_grade type, which columns created under 0.1 are
+// left as after an upgrade until they are converted to the packed grade. They
+// keep the GRADE_* names 0.1 bound its grade type to, so a database that has
+// not run the update yet keeps working with this library.
+
+static Datum
+legacy_grade_in(FunctionCallInfo fcinfo, bool unversioned)
+{
+	SerializedGrade	*serialized;
+	Grade	*grade;
+	char	*input = PG_GETARG_CSTRING(0);
+	int32_t	typmod = -1;
+	size_t	size;
+	PackedGrade	packed;
+	int	error;
+
+	if (PG_NARGS() > 2 && !PG_ARGISNULL(2)) {
+		typmod = PG_GETARG_INT32(2);
 	}
 
-	appendStringInfoString(&si, typmod_str);
-	appendStringInfoChar(&si, ')');
+	error = packed_grade_parse(input, typmod < 0 ? ANYTYPE : (uint32_t)typmod, &packed);
 
-	free(typmod_str);
+	if (error != GRADE_PARSE_OK)
+		ereturn(fcinfo->context, (Datum) 0,
+				(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+				 errmsg("parse error - invalid grade"),
+				 errdetail("%s", grade_parse_error_message(error))));
 
-	PG_RETURN_CSTRING(si.data);
+	if (unversioned) {
+		size = serialized_grade_size_unversioned();
+		serialized = palloc(size + VARHDRSZ);
+		serialized_grade_buffer_write_unversioned(packed,
+				(uint8_t*)serialized + VARHDRSZ);
+		SET_VARSIZE(serialized, size + VARHDRSZ);
+
+		PG_RETURN_SERGRADE_P(serialized);
+	}
+
+	grade = grade_from_packed(packed);
+
+	if (!grade) {
+		ereport(ERROR,(errmsg("parse error - invalid grade")));
+		PG_RETURN_NULL();
+	}
+
+	serialized = serialized_grade_from_grade(grade, &size);
+
+	// insert postgres size header
+	serialized = repalloc(serialized, size + VARHDRSZ);
+	memmove((uint8_t*)serialized + VARHDRSZ, serialized, size);
+	SET_VARSIZE(serialized, size + VARHDRSZ);
+
+	grade_free(grade);
+
+	PG_RETURN_SERGRADE_P(serialized);
+}
+
+// a database still on 0.1 keeps writing the layout 0.1 wrote, so that its
+// rows stay readable by the 0.1 library
+PG_FUNCTION_INFO_V1(GRADE_in);
+
+Datum
+GRADE_in(PG_FUNCTION_ARGS)
+{
+	return legacy_grade_in(fcinfo, true);
+}
+
+PG_FUNCTION_INFO_V1(LEGACY_GRADE_in);
+
+Datum
+LEGACY_GRADE_in(PG_FUNCTION_ARGS)
+{
+	return legacy_grade_in(fcinfo, false);
+}
+
+PG_FUNCTION_INFO_V1(GRADE_out);
+
+Datum
+GRADE_out(PG_FUNCTION_ARGS)
+{
+	SerializedGrade	*serialized = PG_GETARG_SERGRADE_P(0);
+	const char	*str;
+	size_t	len;
+
+	str = packed_grade_string(packed_grade_from_serialized(serialized), &len);
+
+	if (!str)
+		ereport(ERROR,(errmsg("Failed to deserialized grade data")));
+
+	PG_RETURN_CSTRING(pnstrdup(str, len));
 }
 
 PG_FUNCTION_INFO_V1(GRADE_enforce_typmod);
@@ -152,7 +1369,7 @@ PG_FUNCTION_INFO_V1(GRADE_enforce_typmod);
 Datum
 GRADE_enforce_typmod(PG_FUNCTION_ARGS)
 {
-	Grade *grade;
+	PackedGrade packed;
 	SerializedGrade *serialized;
 	int32_t typmod;
 	void *ret;
@@ -163,20 +1380,11 @@ GRADE_enforce_typmod(PG_FUNCTION_ARGS)
 
 	typmod = PG_GETARG_INT32(1);
 
-	grade = grade_from_serialized(serialized);
-
-	if (!grade)
-		ereport(ERROR, errmsg("failed to deserialize grade"));
+	packed = packed_grade_from_serialized(serialized);
 
-        // TODO there could be a useful conversion here, like converting between
-        // alike grade types (e.g. verm -> font)
-
-        if (grade && typmod != grade->type)
+	if (typmod != packed_grade_type(packed))
 		ereport(ERROR, errmsg("typmod mismatched"));
 
-	if (grade)
-		grade_free(grade);
-
 	PG_RETURN_SERGRADE_P(ret);
 }
 
@@ -313,12 +1521,52 @@ GRADE_cmp(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(cmp);
 }
 
+static int
+legacy_grade_fastcmp(Datum x, Datum y, SortSupport ssup)
+{
+	return serialized_grade_cmp(DatumGetSergradeP(x), DatumGetSergradeP(y));
+}
+
+static Datum
+legacy_grade_abbrev_convert(Datum original, SortSupport ssup)
+{
+	return PackedGradeGetDatum(packed_grade_from_serialized(DatumGetSergradeP(original)));
+}
+
+static bool
+legacy_grade_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	// the abbreviated key is the whole grade, so it is never worth aborting
+	return false;
+}
+
+PG_FUNCTION_INFO_V1(LEGACY_GRADE_sortsupport);
+
+Datum
+LEGACY_GRADE_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	if (ssup->abbreviate) {
+		// sort on the packed grade so tuplesort compares integers rather
+		// than following pointers to each varlena
+		ssup->comparator = ssup_datum_unsigned_cmp;
+		ssup->abbrev_converter = legacy_grade_abbrev_convert;
+		ssup->abbrev_abort = legacy_grade_abbrev_abort;
+		ssup->abbrev_full_comparator = legacy_grade_fastcmp;
+	} else {
+		ssup->comparator = legacy_grade_fastcmp;
+	}
+
+	PG_RETURN_VOID();
+}
+
 PG_FUNCTION_INFO_V1(GRADE_type);
 
 Datum
 GRADE_type(PG_FUNCTION_ARGS)
 {
-	Grade *grade;
+	PackedGrade packed;
 	SerializedGrade *serialized;
 	char *type_str;
 	text *type_text;
@@ -327,17 +1575,34 @@ GRADE_type(PG_FUNCTION_ARGS)
 	// TODO this is a little ugly, but it gets the job done for now
 	bytes = PG_GETARG_SERGRADE_P(0) - VARHDRSZ;
 	serialized = (SerializedGrade *)bytes + VARHDRSZ;
-	grade = grade_from_serialized(serialized);
+	packed = packed_grade_from_serialized(serialized);
 
-        // NOTE Grade.type _is_ typmod for valid types (for now)
-        if (typmod_string(&type_str, grade->type) == 0) {
+	// NOTE Grade.type _is_ typmod for valid types (for now)
+	if (typmod_string(&type_str, packed_grade_type(packed)) == 0) {
 		type_text = cstring_to_text(type_str);
-		free(type_str);
+		pfree(type_str);
 	} else {
 		type_text = cstring_to_text("");
 	}
 
-	grade_free(grade);
 	PG_FREE_IF_COPY(bytes, 0);
 	PG_RETURN_TEXT_P(type_text);
 }
+
+PG_FUNCTION_INFO_V1(LEGACY_GRADE_to_grade);
+
+Datum
+LEGACY_GRADE_to_grade(PG_FUNCTION_ARGS)
+{
+	SerializedGrade *serialized = PG_GETARG_SERGRADE_P(0);
+	PackedGrade packed = packed_grade_from_serialized(serialized);
+	uint32_t type = packed_grade_type(packed);
+
+	// a grade in a layout this library can't read comes back typeless
+	if (type != VERMTYPE && type != FONTTYPE && type != YDSTYPE)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("invalid grade type in legacy grade data")));
+
+	PG_RETURN_PACKEDGRADE(packed);
+}
@@ -31,3 +31,235 @@ SELECT grade from grades_unique ORDER BY grade;
 
 -- the types can be gotten by calling the GradeType function
 SELECT grade, GradeType(grade) FROM grades_unique;
+
+-- hash operators allow for hash indexes, joins and aggregation
+CREATE TABLE grades_hash(grade grade);
+CREATE INDEX grades_hash_idx ON grades_hash USING hash (grade);
+INSERT INTO grades_hash VALUES ('V5'), ('F7A+'), ('5.11b'), ('V5');
+SET enable_seqscan = off;
+SELECT grade FROM grades_hash WHERE grade = 'V5';
+RESET enable_seqscan;
+SELECT grade, count(*) FROM grades_hash GROUP BY grade ORDER BY grade;
+
+-- the binary representation is the type followed by the value
+SELECT grade_send('V5'), grade_send('F7A+'), grade_send('5.11b');
+-- and binary copies round trip through it
+\getenv abs_builddir PG_ABS_BUILDDIR
+\set filename :abs_builddir '/results/grades_binary.data'
+CREATE TABLE grades_binary(grade grade, verm grade(verm));
+INSERT INTO grades_binary VALUES ('V5', 'V5'), ('F7A+', 'V2'), ('5.11b', 'V10');
+COPY grades_binary TO :'filename' (FORMAT binary);
+CREATE TABLE grades_binary_copy(LIKE grades_binary);
+COPY grades_binary_copy FROM :'filename' (FORMAT binary);
+SELECT * FROM grades_binary_copy ORDER BY grade;
+-- received grades are checked like parsed ones
+COPY (SELECT '\x0905'::bytea) TO :'filename' (FORMAT binary);
+COPY grades_binary_copy (grade) FROM :'filename' (FORMAT binary);
+COPY (SELECT '\x0211'::bytea) TO :'filename' (FORMAT binary);
+COPY grades_binary_copy (verm) FROM :'filename' (FORMAT binary);
+
+-- grades are parsed strictly
+SELECT 'V5x'::grade;
+SELECT 'F5A'::grade;
+
+-- the planner estimates comparisons from the column statistics
+CREATE TABLE grades_stats AS
+    SELECT CASE WHEN i % 10 = 0 THEN 'V10'::grade ELSE 'V2'::grade END AS grade
+    FROM generate_series(1, 1000) i;
+ANALYZE grades_stats;
+CREATE FUNCTION estimated_rows(query text) RETURNS integer AS $$
+DECLARE
+    plan json;
+BEGIN
+    EXECUTE 'EXPLAIN (FORMAT JSON) ' || query INTO plan;
+    RETURN (plan -> 0 -> 'Plan' ->> 'Plan Rows')::integer;
+END
+$$ LANGUAGE plpgsql;
+SELECT
+    estimated_rows('SELECT * FROM grades_stats WHERE grade = ''V10''') AS eq,
+    estimated_rows('SELECT * FROM grades_stats WHERE grade <> ''V10''') AS ne,
+    estimated_rows('SELECT * FROM grades_stats WHERE grade < ''V10''') AS lt,
+    estimated_rows('SELECT * FROM grades_stats WHERE grade >= ''V10''') AS ge;
+
+-- brin indexes summarize the grades of each block range
+CREATE TABLE grades_brin AS
+    SELECT ('V' || (i % 12))::grade AS grade FROM generate_series(1, 1200) i;
+CREATE INDEX grades_brin_minmax ON grades_brin USING brin (grade);
+SET enable_seqscan = off;
+SELECT count(*) FROM grades_brin WHERE grade >= 'V8';
+SELECT count(*) FROM grades_brin WHERE grade = 'V9';
+DROP INDEX grades_brin_minmax;
+CREATE INDEX grades_brin_bloom ON grades_brin USING brin (grade brin_grade_bloom_ops);
+SELECT count(*) FROM grades_brin WHERE grade = 'V9';
+RESET enable_seqscan;
+
+-- grade ranges are discrete, so their bounds are normalized to [lower,upper)
+SELECT grade_range('V4', 'V7', '[]');
+SELECT '(V4,V7]'::grade_range;
+SELECT 'V7'::grade <@ grade_range('V4', 'V7', '[]');
+SELECT grade_range('V4', 'V7') && grade_range('V7', 'V9');
+-- the hardest V-grade is followed by the easiest Font grade
+SELECT grade_range('V250', 'V255', '[]');
+SELECT grade_range('5.71b', '5.71c', '[]');
+-- adjacent ranges merge
+SELECT grade_multirange(grade_range('V0', 'V3', '[]'), grade_range('V4', 'V6', '[]'));
+
+-- climbers' ability windows can be indexed with gist and spgist
+CREATE TABLE grades_ranges AS
+    SELECT i AS climber,
+        grade_range(('V' || (i % 10))::grade, ('V' || (i % 10 + 3))::grade, '[]') AS ability
+    FROM generate_series(1, 1000) i;
+CREATE INDEX grades_ranges_gist ON grades_ranges USING gist (ability);
+SET enable_seqscan = off;
+SELECT count(*) FROM grades_ranges WHERE ability @> 'V8'::grade;
+SELECT count(*) FROM grades_ranges WHERE ability && grade_range('V11', 'V12', '[]');
+DROP INDEX grades_ranges_gist;
+CREATE INDEX grades_ranges_spgist ON grades_ranges USING spgist (ability);
+SELECT count(*) FROM grades_ranges WHERE ability @> 'V8'::grade;
+RESET enable_seqscan;
+
+-- grades convert between scales, going through the V-scale
+SELECT grade_convert('V5', 'font'), grade_convert('F7A', 'yds'), grade_convert('5.13a', 'verm');
+SELECT grade_convert('V18', 'font');
+SELECT grade_convert('V5', 'nope');
+-- explicitly casting to a typmod converts, assigning one does not
+SELECT 'F7A+'::grade::grade(verm);
+INSERT INTO grades_4 SELECT 'F7A+'::grade;
+CREATE TABLE grades_convert(grade grade);
+INSERT INTO grades_convert VALUES ('V5'), ('F7A+'), ('5.12a');
+UPDATE grades_convert SET grade = grade_convert(grade, 'font');
+SELECT grade FROM grades_convert ORDER BY grade;
+ALTER TABLE grades_convert ALTER grade TYPE grade(verm) USING grade::grade(verm);
+SELECT grade FROM grades_convert ORDER BY grade;
+
+-- min and max order across scales like the btree operators do
+CREATE TABLE grades_agg(climber integer, grade grade);
+INSERT INTO grades_agg VALUES
+    (1, 'V3'), (1, 'V7'), (1, NULL), (2, 'F6A'), (2, 'V10'), (3, NULL);
+SELECT climber, min(grade), max(grade) FROM grades_agg GROUP BY climber ORDER BY climber;
+SELECT aggfnoid::regprocedure, aggcombinefn, aggsortop::regoperator
+    FROM pg_aggregate
+    WHERE aggfnoid IN ('min(grade)'::regprocedure, 'max(grade)'::regprocedure)
+    ORDER BY aggfnoid::regprocedure::text;
+
+-- histograms count every grade of every scale in a fixed-size state
+SELECT grade_histogram(grade) FROM grades_agg;
+SELECT climber, grade_histogram(grade) FROM grades_agg GROUP BY climber ORDER BY climber;
+SELECT grade_histogram(grade) FROM grades_agg WHERE false;
+SELECT '{V5:2,F6A:1}'::grade_histogram + '{V5:1,5.10a:3}';
+SELECT '{V5:2,F6A:1}'::grade_histogram - '{V5:2}';
+SELECT '{V5:2,F6A:1}'::grade_histogram -> 'V5', '{V5:2,F6A:1}'::grade_histogram -> 'V6';
+SELECT '{V5:2'::grade_histogram;
+-- counts are never negative
+SELECT '{V5:-1}'::grade_histogram;
+SELECT '{V5:1,F6A:1}'::grade_histogram - '{V5:2}';
+-- histograms round trip through binary copies
+CREATE TABLE grades_histograms AS
+    SELECT climber, grade_histogram(grade) AS histogram FROM grades_agg GROUP BY climber;
+COPY grades_histograms TO :'filename' (FORMAT binary);
+CREATE TABLE grades_histograms_copy(LIKE grades_histograms);
+COPY grades_histograms_copy FROM :'filename' (FORMAT binary);
+SELECT climber, histogram FROM grades_histograms_copy ORDER BY climber;
+-- partial histograms from parallel workers are combined
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SELECT grade_histogram(grade) FROM grades_brin;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+
+-- percentile_disc and mode count grades instead of sorting them
+SELECT percentile_disc(0.5) WITHIN GROUP (ORDER BY grade),
+    percentile_disc(ARRAY[0, 0.25, 0.75, 1, NULL]) WITHIN GROUP (ORDER BY grade),
+    mode() WITHIN GROUP (ORDER BY grade)
+    FROM grades_agg;
+SELECT mode() WITHIN GROUP (ORDER BY g)
+    FROM (VALUES ('V5'::grade), ('F6A'), ('F6A'), ('V5'), ('F6A'), (NULL)) v(g);
+SELECT percentile_disc(0.5) WITHIN GROUP (ORDER BY grade) FROM grades_agg WHERE climber = 3;
+SELECT percentile_disc(1.5) WITHIN GROUP (ORDER BY grade) FROM grades_agg;
+-- and agree with the built-in aggregates, which sort
+SELECT f, percentile_disc(f) WITHIN GROUP (ORDER BY grade) AS counted,
+    pg_catalog.percentile_disc(f) WITHIN GROUP (ORDER BY grade) AS sorted
+    FROM grades_brin, (VALUES (0::float8), (0.1), (0.5), (0.99), (1)) p(f)
+    GROUP BY f ORDER BY f;
+
+-- top k keeps the hardest grades of each group in a bounded heap
+SELECT climber, grade_top_k(grade, 1) FROM grades_agg GROUP BY climber ORDER BY climber;
+SELECT grade_top_k(grade, 3) FROM grades_brin;
+SELECT grade_top_k(grade, 0) FROM grades_agg;
+CREATE TABLE grades_ascents(climber integer, grade grade, points float8);
+INSERT INTO grades_ascents VALUES
+    (1, 'V5', 500), (1, 'V7', 700), (1, 'V7', 750), (1, 'V3', 300), (2, 'V9', 900), (2, NULL, 1000);
+SELECT climber, grade_top_k(grade, 2), grade_top_k_points(grade, points, 2)
+    FROM grades_ascents GROUP BY climber ORDER BY climber;
+
+-- sliding window frames remove the grades leaving the frame
+CREATE TABLE grades_window AS
+    SELECT n, g::grade AS grade
+    FROM (VALUES (1, 'V5'), (2, 'V8'), (3, 'V3'), (4, 'V4'), (5, NULL), (6, 'V2'), (7, 'F6A')) v(n, g);
+SELECT n, grade, min(grade) OVER w, max(grade) OVER w, grade_histogram(grade) OVER w
+    FROM grades_window
+    WINDOW w AS (ORDER BY n ROWS BETWEEN 2 PRECEDING AND CURRENT ROW)
+    ORDER BY n;
+
+-- arrays of grade strings parse in one call, keeping nulls and bounds
+SELECT grade_parse_array(ARRAY['V5', 'F6A+', '5.12a', NULL]);
+SELECT grade_parse_array('{V5,V0007}', 'verm');
+SELECT grade_parse_array('[0:2]={V1,V2,V3}');
+SELECT grade_parse_array('{}');
+SELECT grade_parse_array(ARRAY['V5', 'F6A', 'V9x']);
+SELECT grade_parse_array(ARRAY['V5', 'F6A'], 'verm');
+SELECT grade_parse_array(ARRAY['V5'], 'nope');
+
+-- gin indexes answer containment and overlap of grade arrays
+CREATE TABLE grades_areas AS
+    SELECT i AS area, ARRAY[('V' || (i % 10))::grade, ('V' || (i % 7))::grade] AS grades
+    FROM generate_series(1, 1000) i;
+CREATE INDEX grades_areas_gin ON grades_areas USING gin (grades);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT area FROM grades_areas WHERE grades @> ARRAY['V8', 'V3']::grade[];
+SELECT count(*) FROM grades_areas WHERE grades @> ARRAY['V8', 'V3']::grade[];
+SELECT count(*) FROM grades_areas WHERE grades && ARRAY['V9']::grade[];
+SELECT count(*) FROM grades_areas WHERE grades <@ ARRAY['V0', 'V1', 'V2']::grade[];
+SELECT count(*) FROM grades_areas WHERE grades = ARRAY['V3', 'V3']::grade[];
+RESET enable_seqscan;
+
+-- typmod casts the grades already satisfy are removed, so they don't rewrite the table
+CREATE TABLE grades_typmod(verm grade(verm));
+INSERT INTO grades_typmod VALUES ('V3'), ('V7');
+CREATE FUNCTION grades_typmod_same(grade grade) RETURNS grade AS 'SELECT grade' LANGUAGE sql IMMUTABLE;
+SELECT relfilenode FROM pg_class WHERE relname = 'grades_typmod' \gset
+ALTER TABLE grades_typmod ALTER verm TYPE grade(verm) USING grades_typmod_same(verm);
+SELECT relfilenode = :relfilenode AS not_rewritten FROM pg_class WHERE relname = 'grades_typmod';
+ALTER TABLE grades_typmod ALTER verm TYPE grade(font) USING grades_typmod_same(verm)::grade(font);
+SELECT relfilenode = :relfilenode AS not_rewritten FROM pg_class WHERE relname = 'grades_typmod';
+SELECT verm FROM grades_typmod ORDER BY verm;
+
+-- repeated grades are parsed once and then found in the call site's cache
+CREATE TABLE grades_copy(grade grade, verm grade(verm));
+COPY grades_copy FROM stdin;
+V5	V5
+F6A+	V3
+V5	V5
+F6A+	V3
+5.10a	V0
+V0005	V5
+\.
+SELECT grade, verm, count(*) FROM grades_copy GROUP BY grade, verm ORDER BY grade, verm;
+SELECT g::grade FROM (VALUES ('V5'), ('F6A+'), ('V5'), ('V5x')) v(g);
+
+-- input errors are soft, so they can be checked and skipped without failing
+SELECT pg_input_is_valid('V5', 'grade'), pg_input_is_valid('V5x', 'grade'), pg_input_is_valid('F6A', 'grade(verm)');
+SELECT * FROM pg_input_error_info('V5x', 'grade');
+SELECT * FROM pg_input_error_info('V256', 'grade');
+CREATE TABLE grades_skipped(grade grade, verm grade(verm));
+COPY grades_skipped FROM stdin WITH (ON_ERROR ignore);
+V5	V5
+V5x	V5
+F6A+	V3
+F6A+	F6A+
+	
+5.10a	V0
+\.
+SELECT grade, verm FROM grades_skipped ORDER BY grade;
@@ -0,0 +1,83 @@
+-- start over from the oldest version, previous tests install the default one
+SET client_min_messages = warning;
+DROP EXTENSION IF EXISTS pg_climb CASCADE;
+RESET client_min_messages;
+
+CREATE EXTENSION pg_climb VERSION '0.1';
+CREATE TABLE grades_upgrade(grade grade, verm grade(verm));
+
+-- a database that hasn't been updated yet keeps working with the new library
+INSERT INTO grades_upgrade VALUES ('V5', 'V5'), ('F7A+', 'V2'), ('5.11b', 'V10');
+INSERT INTO grades_upgrade VALUES ('V5', 'F7A+');
+SELECT grade, verm, GradeType(grade) FROM grades_upgrade ORDER BY grade;
+SELECT count(*) FROM grades_upgrade WHERE grade > 'V5';
+CREATE INDEX grades_upgrade_verm ON grades_upgrade (verm);
+SET enable_seqscan = off;
+SELECT verm FROM grades_upgrade WHERE verm >= 'V5' ORDER BY verm;
+RESET enable_seqscan;
+
+ALTER EXTENSION pg_climb UPDATE TO '0.2';
+
+-- columns created under 0.1 are left with the variable-length representation
+SELECT attname, format_type(atttypid, atttypmod)
+    FROM pg_attribute
+    WHERE attrelid = 'grades_upgrade'::regclass AND attnum > 0
+    ORDER BY attnum;
+
+-- and keep working as before, next to the rows written under 0.1
+INSERT INTO grades_upgrade VALUES ('V7', 'V7'), ('F6A', 'V1');
+INSERT INTO grades_upgrade VALUES ('V5', 'F7A+');
+SELECT grade, verm, GradeType(grade) FROM grades_upgrade ORDER BY grade, verm;
+SELECT count(*) FROM grades_upgrade WHERE grade > 'V5';
+SET enable_seqscan = off;
+SELECT verm FROM grades_upgrade WHERE verm >= 'V5' ORDER BY verm;
+RESET enable_seqscan;
+SELECT grade::grade, verm::grade(verm) FROM grades_upgrade ORDER BY 1, 2;
+-- new values are written in the compact serialized layout, the rows from 0.1
+-- are left as they were
+SELECT pg_column_size(grade), count(*) FROM grades_upgrade GROUP BY 1 ORDER BY 1;
+-- and compare with the new ones whatever their layout
+SELECT grade, pg_column_size(grade) FROM grades_upgrade WHERE grade = 'V5';
+SELECT a.grade AS old, b.grade AS new, a.grade < b.grade AS lt, a.grade > b.grade AS gt
+    FROM grades_upgrade a, grades_upgrade b
+    WHERE pg_column_size(a.grade) = 9 AND pg_column_size(b.grade) = 6
+    ORDER BY a.grade, b.grade;
+-- a grade this library can't read, like one from a newer layout, isn't converted
+CREATE CAST (bytea AS legacy_grade) WITHOUT FUNCTION;
+SELECT '\xa105'::bytea::legacy_grade::grade;
+DROP CAST (bytea AS legacy_grade);
+
+-- until they are converted to the packed representation
+ALTER TABLE grades_upgrade
+    ALTER COLUMN grade TYPE grade,
+    ALTER COLUMN verm TYPE grade(verm);
+SELECT attname, format_type(atttypid, atttypmod)
+    FROM pg_attribute
+    WHERE attrelid = 'grades_upgrade'::regclass AND attnum > 0
+    ORDER BY attnum;
+SELECT grade, verm, GradeType(grade) FROM grades_upgrade ORDER BY grade, verm;
+INSERT INTO grades_upgrade VALUES ('V5', 'F7A+');
+
+-- a fresh install has the same objects as an updated one, so that a dump of
+-- an updated database restores into it
+CREATE TEMP TABLE upgraded_objects AS
+    SELECT pg_describe_object(classid, objid, objsubid) AS object
+    FROM pg_depend
+    WHERE refclassid = 'pg_extension'::regclass AND deptype = 'e'
+        AND refobjid = (SELECT oid FROM pg_extension WHERE extname = 'pg_climb');
+DROP TABLE grades_upgrade;
+DROP EXTENSION pg_climb;
+CREATE EXTENSION pg_climb;
+CREATE TEMP TABLE fresh_objects AS
+    SELECT pg_describe_object(classid, objid, objsubid) AS object
+    FROM pg_depend
+    WHERE refclassid = 'pg_extension'::regclass AND deptype = 'e'
+        AND refobjid = (SELECT oid FROM pg_extension WHERE extname = 'pg_climb');
+(SELECT 'upgraded' AS only_in, object FROM upgraded_objects
+    EXCEPT SELECT 'upgraded', object FROM fresh_objects)
+UNION ALL
+(SELECT 'fresh', object FROM fresh_objects
+    EXCEPT SELECT 'fresh', object FROM upgraded_objects)
+ORDER BY 1, 2;
+SELECT object FROM fresh_objects WHERE object LIKE '%legacy_grade%' ORDER BY object COLLATE "C";
+SELECT 'V5'::legacy_grade::grade;
@@ -1,5 +1,6 @@
 #include <check.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pg_climb.h"
 
 START_TEST(test_grade_type_name)
@@ -110,6 +111,47 @@ START_TEST(test_grade_cmp)
 }
 END_TEST
 
+static int allocations;
+
+static void *counting_alloc(size_t size)
+{
+	allocations++;
+	return malloc(size);
+}
+
+static void counting_free(void *ptr)
+{
+	allocations--;
+	free(ptr);
+}
+
+START_TEST(test_grade_allocator)
+{
+	const GradeAllocator counting = { counting_alloc, counting_free };
+	Grade *grade;
+	char *string;
+
+	grade_set_allocator(&counting);
+	allocations = 0;
+
+	grade = grade_from_string("5.12c", ANYTYPE);
+	ck_assert_ptr_nonnull(grade);
+	ck_assert_int_gt(allocations, 0);
+
+	string = grade_to_string(grade);
+	counting_free(string);
+	grade_free(grade);
+	ck_assert_int_eq(allocations, 0);
+
+	// failed parses release what they allocated
+	grade = grade_from_string("nope", ANYTYPE);
+	ck_assert_ptr_null(grade);
+	ck_assert_int_eq(allocations, 0);
+
+	grade_set_allocator(NULL);
+}
+END_TEST
+
 START_TEST(test_typmod_string)
 {
 	char *str;
@@ -457,17 +499,18 @@ START_TEST(test_serial_verm)
 	u_int8_t *data;
 	size_t size;
 
-	// constant size 4(type)+1(value)
-	ck_assert_uint_eq(serialized_grade_size_from_verm(), 5);
+	// constant size 1(header)+1(value)
+	ck_assert_uint_eq(serialized_grade_size_from_verm(), 2);
 
 	// serialize
 	verm = verm_create(5);
 	ser = serialized_grade_from_verm(verm, &size);
 	ck_assert_ptr_nonnull(ser);
-	ck_assert_uint_eq(size, 5);
+	ck_assert_uint_eq(size, 2);
 	data = (u_int8_t*)ser->data;
-	ck_assert_uint_eq(serialized_grade_data_read_uint32_t(data), VERMTYPE);
-	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+4), 5);
+	ck_assert_uint_eq(serialized_grade_data_version(data), SERIALIZED_GRADE_VERSION);
+	ck_assert_uint_eq(serialized_grade_data_type(data), VERMTYPE);
+	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+1), 5);
 
 	verm_free(verm);
 	verm = NULL;
@@ -489,17 +532,18 @@ START_TEST(test_serial_font)
 	u_int8_t *data;
 	size_t size;
 
-	// constant size 4(type)+1(value)
-	ck_assert_uint_eq(serialized_grade_size_from_font(), 5);
+	// constant size 1(header)+1(value)
+	ck_assert_uint_eq(serialized_grade_size_from_font(), 2);
 
 	// serialize
 	font = font_create(12);
 	ser = serialized_grade_from_font(font, &size);
 	ck_assert_ptr_nonnull(ser);
-	ck_assert_uint_eq(size, 5);
+	ck_assert_uint_eq(size, 2);
 	data = (u_int8_t*)ser->data;
-	ck_assert_uint_eq(serialized_grade_data_read_uint32_t(data), FONTTYPE);
-	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+4), 12);
+	ck_assert_uint_eq(serialized_grade_data_version(data), SERIALIZED_GRADE_VERSION);
+	ck_assert_uint_eq(serialized_grade_data_type(data), FONTTYPE);
+	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+1), 12);
 
 	font_free(font);
 	font = NULL;
@@ -521,17 +565,18 @@ START_TEST(test_serial_yds)
 	u_int8_t *data;
 	size_t size;
 
-	// constant size 4(type)+1(value)
-	ck_assert_uint_eq(serialized_grade_size_from_yds(), 5);
+	// constant size 1(header)+1(value)
+	ck_assert_uint_eq(serialized_grade_size_from_yds(), 2);
 
 	// serialize
 	yds = yds_create(12);
 	ser = serialized_grade_from_yds(yds, &size);
 	ck_assert_ptr_nonnull(ser);
-	ck_assert_uint_eq(size, 5);
+	ck_assert_uint_eq(size, 2);
 	data = (u_int8_t*)ser->data;
-	ck_assert_uint_eq(serialized_grade_data_read_uint32_t(data), YDSTYPE);
-	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+4), 12);
+	ck_assert_uint_eq(serialized_grade_data_version(data), SERIALIZED_GRADE_VERSION);
+	ck_assert_uint_eq(serialized_grade_data_type(data), YDSTYPE);
+	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+1), 12);
 
 	yds_free(yds);
 	yds = NULL;
@@ -561,10 +606,11 @@ START_TEST(test_serial_grade)
 	grade = grade_from_string("V6", ANYTYPE);
 	ser = serialized_grade_from_grade(grade, &size);
 	ck_assert_ptr_nonnull(ser);
-	ck_assert_uint_eq(size, 5);
+	ck_assert_uint_eq(size, 2);
 	data = (u_int8_t*)ser->data;
-	ck_assert_uint_eq(serialized_grade_data_read_uint32_t(data), VERMTYPE);
-	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+4), 6);
+	ck_assert_uint_eq(serialized_grade_data_version(data), SERIALIZED_GRADE_VERSION);
+	ck_assert_uint_eq(serialized_grade_data_type(data), VERMTYPE);
+	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+1), 6);
 
 	grade_free(grade);
 	grade = NULL;
@@ -584,10 +630,11 @@ START_TEST(test_serial_grade)
 	grade = grade_from_string("F8A", ANYTYPE);
 	ser = serialized_grade_from_grade(grade, &size);
 	ck_assert_ptr_nonnull(ser);
-	ck_assert_uint_eq(size, 5);
+	ck_assert_uint_eq(size, 2);
 	data = (u_int8_t*)ser->data;
-	ck_assert_uint_eq(serialized_grade_data_read_uint32_t(data), FONTTYPE);
-	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+4), 22);
+	ck_assert_uint_eq(serialized_grade_data_version(data), SERIALIZED_GRADE_VERSION);
+	ck_assert_uint_eq(serialized_grade_data_type(data), FONTTYPE);
+	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+1), 22);
 
 	grade_free(grade);
 	grade = NULL;
@@ -607,10 +654,11 @@ START_TEST(test_serial_grade)
 	grade = grade_from_string("5.11b", ANYTYPE);
 	ser = serialized_grade_from_grade(grade, &size);
 	ck_assert_ptr_nonnull(ser);
-	ck_assert_uint_eq(size, 5);
+	ck_assert_uint_eq(size, 2);
 	data = (u_int8_t*)ser->data;
-	ck_assert_uint_eq(serialized_grade_data_read_uint32_t(data), YDSTYPE);
-	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+4), 14);
+	ck_assert_uint_eq(serialized_grade_data_version(data), SERIALIZED_GRADE_VERSION);
+	ck_assert_uint_eq(serialized_grade_data_type(data), YDSTYPE);
+	ck_assert_uint_eq(serialized_grade_data_read_uint8_t(data+1), 14);
 
 	grade_free(grade);
 	grade = NULL;
@@ -626,6 +674,63 @@ START_TEST(test_serial_grade)
 	grade_free(grade);
 }
 
+START_TEST(test_serial_legacy)
+{
+	Grade *grade;
+	SerializedGrade *ser;
+	Font *font;
+	u_int8_t legacy[5];
+	u_int8_t unversioned[5];
+	u_int8_t future[2];
+	u_int32_t type = FONTTYPE;
+	size_t size;
+
+	// grades serialized by 0.1 are a native-endian type followed by the value
+	memcpy(legacy, &type, sizeof(type));
+	legacy[4] = 12;
+	ck_assert_uint_eq(serialized_grade_data_version(legacy), 0);
+	ck_assert_uint_eq(serialized_grade_data_type(legacy), FONTTYPE);
+
+	font = font_from_serialized_grade_data(legacy, &size);
+	ck_assert_ptr_nonnull(font);
+	ck_assert_uint_eq(size, 5);
+	ck_assert_uint_eq(font_get_value(font), 12);
+	font_free(font);
+
+	grade = grade_from_serialized((SerializedGrade *)legacy);
+	ck_assert_ptr_nonnull(grade);
+	ck_assert_uint_eq(grade->type, FONTTYPE);
+	ck_assert_uint_eq(packed_grade_from_serialized((SerializedGrade *)legacy),
+			  packed_grade_make(FONTTYPE, 12));
+
+	// which is what a database still on 0.1 keeps writing
+	memset(unversioned, 0xff, sizeof(unversioned));
+	ck_assert_uint_eq(serialized_grade_size_unversioned(), sizeof(legacy));
+	ck_assert_uint_eq(serialized_grade_buffer_write_unversioned(
+				  packed_grade_make(FONTTYPE, 12), unversioned), sizeof(legacy));
+	ck_assert_mem_eq(unversioned, legacy, sizeof(legacy));
+
+	// and compare with grades in the compact layout
+	ser = serialized_grade_from_grade(grade, NULL);
+	ck_assert_int_eq(serialized_grade_cmp(ser, (SerializedGrade *)legacy), 0);
+	serialized_grade_free(ser);
+	grade_free(grade);
+
+	grade = grade_from_string("F6A", ANYTYPE);
+	ser = serialized_grade_from_grade(grade, NULL);
+	ck_assert_int_lt(serialized_grade_cmp(ser, (SerializedGrade *)legacy), 0);
+	serialized_grade_free(ser);
+	grade_free(grade);
+
+	// a version this library doesn't know can't be read
+	future[0] = 0x80 | ((SERIALIZED_GRADE_VERSION + 1) << 4) | VERMTYPE;
+	future[1] = 5;
+	ck_assert_uint_eq(serialized_grade_data_version(future), SERIALIZED_GRADE_VERSION + 1);
+	ck_assert_uint_eq(serialized_grade_data_type(future), ANYTYPE);
+	ck_assert_ptr_null(grade_from_serialized((SerializedGrade *)future));
+}
+END_TEST
+
 START_TEST(test_serial_cmp)
 {
 	Grade *g1;
@@ -638,7 +743,22 @@ START_TEST(test_serial_cmp)
 	sg1 = serialized_grade_from_grade(g1, NULL);
 	sg2 = serialized_grade_from_grade(g2, NULL);
 
-	ck_assert_int_le(serialized_grade_cmp(sg1, sg2), 0);
+	ck_assert_int_lt(serialized_grade_cmp(sg1, sg2), 0);
+	ck_assert_int_gt(serialized_grade_cmp(sg2, sg1), 0);
+	ck_assert_int_eq(serialized_grade_cmp(sg1, sg1), 0);
+	serialized_grade_free(sg1);
+	serialized_grade_free(sg2);
+	grade_free(g1);
+	grade_free(g2);
+
+	// types are ordered before values
+	g1 = grade_from_string("V16", ANYTYPE);
+	g2 = grade_from_string("5.1", ANYTYPE);
+	sg1 = serialized_grade_from_grade(g1, NULL);
+	sg2 = serialized_grade_from_grade(g2, NULL);
+
+	ck_assert_int_lt(serialized_grade_cmp(sg1, sg2), 0);
+	ck_assert_int_eq(serialized_grade_cmp(sg1, sg2), grade_cmp(g1, g2) < 0 ? -1 : 1);
 	serialized_grade_free(sg1);
 	serialized_grade_free(sg2);
 	grade_free(g1);
@@ -646,6 +766,538 @@ START_TEST(test_serial_cmp)
 }
 END_TEST
 
+START_TEST(test_packed_grade)
+{
+	Grade *grade;
+	SerializedGrade *ser;
+	PackedGrade packed;
+	char *string;
+
+	packed = packed_grade_make(FONTTYPE, 21);
+	ck_assert_uint_eq(packed_grade_type(packed), FONTTYPE);
+	ck_assert_uint_eq(packed_grade_value(packed), 21);
+
+	// pack
+	grade = grade_from_string("5.11b", ANYTYPE);
+	packed = packed_grade_from_grade(grade);
+	ck_assert_uint_eq(packed_grade_type(packed), YDSTYPE);
+	ck_assert_uint_eq(packed_grade_value(packed), 14);
+	grade_free(grade);
+
+	// unpack
+	grade = grade_from_packed(packed);
+	ck_assert_ptr_nonnull(grade);
+	ck_assert_uint_eq(grade->type, YDSTYPE);
+	string = grade_to_string(grade);
+	ck_assert_str_eq(string, "5.11b");
+	free(string);
+	grade_free(grade);
+
+	grade = grade_from_packed(packed_grade_make(ANYTYPE, 0));
+	ck_assert_ptr_null(grade);
+
+	// from serialized data, without deserializing
+	grade = grade_from_string("F7A+", ANYTYPE);
+	ser = serialized_grade_from_grade(grade, NULL);
+	packed = packed_grade_from_serialized(ser);
+	ck_assert_uint_eq(packed, packed_grade_from_grade(grade));
+	serialized_grade_free(ser);
+	grade_free(grade);
+}
+END_TEST
+
+START_TEST(test_packed_cmp)
+{
+	PackedGrade p1;
+	PackedGrade p2;
+
+	p1 = packed_grade_make(VERMTYPE, 6);
+	p2 = packed_grade_make(VERMTYPE, 6);
+	ck_assert_int_eq(packed_grade_cmp(p1, p2), 0);
+
+	p2 = packed_grade_make(VERMTYPE, 7);
+	ck_assert_int_lt(packed_grade_cmp(p1, p2), 0);
+	ck_assert_int_gt(packed_grade_cmp(p2, p1), 0);
+
+	// types are ordered before values, like grade_cmp
+	p1 = packed_grade_make(VERMTYPE, 255);
+	p2 = packed_grade_make(FONTTYPE, 0);
+	ck_assert_int_lt(packed_grade_cmp(p1, p2), 0);
+}
+END_TEST
+
+START_TEST(test_packed_next)
+{
+	PackedGrade packed;
+	PackedGrade next;
+
+	packed = packed_grade_make(VERMTYPE, 6);
+	ck_assert_int_eq(packed_grade_next(packed, &next), 0);
+	ck_assert_int_eq(next, packed_grade_make(VERMTYPE, 7));
+	ck_assert_int_eq(packed_grade_distance(next, packed), 1);
+	ck_assert_int_eq(packed_grade_distance(packed, next), -1);
+
+	// the hardest grade of a scale is followed by the easiest of the next
+	packed = packed_grade_make(VERMTYPE, 255);
+	ck_assert_int_eq(packed_grade_next(packed, &next), 0);
+	ck_assert_int_eq(next, packed_grade_make(FONTTYPE, 0));
+	ck_assert_int_lt(packed_grade_cmp(packed, next), 0);
+	ck_assert_int_eq(packed_grade_distance(next, packed), 1);
+
+	packed = packed_grade_make(FONTTYPE, 255);
+	ck_assert_int_eq(packed_grade_next(packed, &next), 0);
+	ck_assert_int_eq(next, packed_grade_make(YDSTYPE, 0));
+
+	// but nothing follows the hardest grade of the last scale
+	ck_assert_int_ne(packed_grade_next(packed_grade_make(YDSTYPE, 255), &next), 0);
+	ck_assert_int_ne(packed_grade_next(packed_grade_make(ANYTYPE, 0), &next), 0);
+}
+END_TEST
+
+START_TEST(test_packed_buffer)
+{
+	PackedGrade packed;
+	uint8_t buf[2];
+	size_t size;
+
+	ck_assert_uint_eq(packed_grade_buffer_size(), 2);
+
+	// write
+	packed = packed_grade_make(FONTTYPE, 17);
+	size = packed_grade_buffer_write(packed, buf);
+	ck_assert_uint_eq(size, 2);
+	ck_assert_uint_eq(buf[0], FONTTYPE);
+	ck_assert_uint_eq(buf[1], 17);
+
+	// read
+	packed = packed_grade_from_buffer(buf, &size);
+	ck_assert_uint_eq(size, 2);
+	ck_assert_uint_eq(packed_grade_type(packed), FONTTYPE);
+	ck_assert_uint_eq(packed_grade_value(packed), 17);
+}
+END_TEST
+
+START_TEST(test_packed_parse)
+{
+	PackedGrade packed;
+
+	ck_assert_int_eq(packed_grade_parse(NULL, ANYTYPE, &packed), GRADE_PARSE_EMPTY);
+	ck_assert_int_eq(packed_grade_parse("", ANYTYPE, &packed), GRADE_PARSE_EMPTY);
+
+	// each scale is found from the first character
+	ck_assert_int_eq(packed_grade_parse("v12", ANYTYPE, &packed), 0);
+	ck_assert_uint_eq(packed, packed_grade_make(VERMTYPE, 12));
+	ck_assert_int_eq(packed_grade_parse("F8B+", ANYTYPE, &packed), 0);
+	ck_assert_uint_eq(packed, packed_grade_make(FONTTYPE, 25));
+	ck_assert_int_eq(packed_grade_parse("5.12d", ANYTYPE, &packed), 0);
+	ck_assert_uint_eq(packed, packed_grade_make(YDSTYPE, 20));
+
+	// the type hint restricts which scale may match
+	ck_assert_int_eq(packed_grade_parse("V3", VERMTYPE, &packed), 0);
+	ck_assert_int_eq(packed_grade_parse("V3", FONTTYPE, &packed), GRADE_PARSE_WRONG_SCALE);
+	ck_assert_int_eq(packed_grade_parse("F3", YDSTYPE, &packed), GRADE_PARSE_WRONG_SCALE);
+	ck_assert_int_eq(packed_grade_parse("5.9", VERMTYPE, &packed), GRADE_PARSE_WRONG_SCALE);
+	ck_assert_ptr_null(grade_from_string("F3", VERMTYPE));
+
+	// trailing characters
+	ck_assert_int_eq(packed_grade_parse("V5 ", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+	ck_assert_int_eq(packed_grade_parse("F5A", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+	ck_assert_int_eq(packed_grade_parse("F7A++", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+	ck_assert_int_eq(packed_grade_parse("5.10ab", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+
+	// unknown scales
+	ck_assert_int_eq(packed_grade_parse("X5", ANYTYPE, &packed), GRADE_PARSE_UNKNOWN_SCALE);
+	ck_assert_int_eq(packed_grade_parse(" V5", ANYTYPE, &packed), GRADE_PARSE_UNKNOWN_SCALE);
+
+	// missing parts
+	ck_assert_int_eq(packed_grade_parse("Vx", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+	ck_assert_int_eq(packed_grade_parse("F7", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+	ck_assert_int_eq(packed_grade_parse("5", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+	ck_assert_int_eq(packed_grade_parse("5.11", ANYTYPE, &packed), GRADE_PARSE_SYNTAX);
+
+	// out of range
+	ck_assert_int_eq(packed_grade_parse("F0", ANYTYPE, &packed), GRADE_PARSE_OUT_OF_RANGE);
+	ck_assert_int_eq(packed_grade_parse("5.0", ANYTYPE, &packed), GRADE_PARSE_OUT_OF_RANGE);
+	ck_assert_int_eq(packed_grade_parse("F47A", ANYTYPE, &packed), GRADE_PARSE_OUT_OF_RANGE);
+	ck_assert_int_eq(packed_grade_parse("5.71d", ANYTYPE, &packed), GRADE_PARSE_OUT_OF_RANGE);
+	ck_assert_int_eq(packed_grade_parse("V99999999999", ANYTYPE, &packed), GRADE_PARSE_OUT_OF_RANGE);
+	ck_assert_int_eq(packed_grade_parse("F46C+", ANYTYPE, &packed), 0);
+	ck_assert_uint_eq(packed_grade_value(packed), 255);
+	ck_assert_int_eq(packed_grade_parse("5.71c", ANYTYPE, &packed), 0);
+	ck_assert_uint_eq(packed_grade_value(packed), 255);
+
+	// every error can be explained
+	ck_assert_str_eq(grade_parse_error_message(GRADE_PARSE_WRONG_SCALE),
+			 "The grade is not on the expected scale.");
+}
+END_TEST
+
+// converts str to the given type and formats the result, NULL if it can't be
+static const char *convert_string(const char *str, uint32_t type)
+{
+	PackedGrade packed;
+	PackedGrade converted;
+
+	if (packed_grade_parse(str, ANYTYPE, &packed) != 0
+	    || packed_grade_convert(packed, type, &converted) != 0)
+		return NULL;
+
+	return packed_grade_string(converted, NULL);
+}
+
+START_TEST(test_packed_convert)
+{
+	const uint32_t types[] = { FONTTYPE, YDSTYPE };
+	PackedGrade packed;
+	PackedGrade converted;
+	PackedGrade back;
+
+	ck_assert_str_eq(convert_string("V5", FONTTYPE), "F6C");
+	ck_assert_str_eq(convert_string("F7A+", VERMTYPE), "V7");
+	ck_assert_str_eq(convert_string("F7A", YDSTYPE), "5.12c");
+	ck_assert_str_eq(convert_string("5.13a", VERMTYPE), "V8");
+	ck_assert_str_eq(convert_string("V17", FONTTYPE), "F9A");
+
+	// converting to the same scale, or to any scale, changes nothing
+	ck_assert_str_eq(convert_string("V5", VERMTYPE), "V5");
+	ck_assert_str_eq(convert_string("V5", ANYTYPE), "V5");
+
+	// easy grades are lumped in with V0, hard ones have no equivalent
+	ck_assert_str_eq(convert_string("F3", VERMTYPE), "V0");
+	ck_assert_str_eq(convert_string("5.10a", VERMTYPE), "V0");
+	ck_assert_ptr_null(convert_string("V18", FONTTYPE));
+	ck_assert_ptr_null(convert_string("F9A+", YDSTYPE));
+	ck_assert_int_ne(packed_grade_convert(packed_grade_make(ANYTYPE, 0), VERMTYPE, &converted), 0);
+
+	// every V-grade that converts, converts back to itself
+	for (int t = 0; t < 2; t++) {
+		for (int v = 0; v <= 17; v++) {
+			packed = packed_grade_make(VERMTYPE, v);
+			ck_assert_int_eq(packed_grade_convert(packed, types[t], &converted), 0);
+			ck_assert_int_eq(packed_grade_convert(converted, VERMTYPE, &back), 0);
+			ck_assert_uint_eq(back, packed);
+		}
+	}
+}
+END_TEST
+
+START_TEST(test_packed_string)
+{
+	const uint32_t types[] = { VERMTYPE, FONTTYPE, YDSTYPE };
+	PackedGrade packed;
+	PackedGrade parsed;
+	const char *str;
+	char *string;
+	size_t len;
+
+	ck_assert_ptr_null(packed_grade_string(packed_grade_make(ANYTYPE, 0), NULL));
+
+	str = packed_grade_string(packed_grade_make(FONTTYPE, 255), &len);
+	ck_assert_str_eq(str, "F46C+");
+	ck_assert_uint_eq(len, 5);
+
+	string = packed_grade_to_string(packed_grade_make(YDSTYPE, 255));
+	ck_assert_str_eq(string, "5.71c");
+	free(string);
+
+	// every value of every scale formats to a string that parses back to it
+	for (int t = 0; t < 3; t++) {
+		for (int v = 0; v <= 255; v++) {
+			packed = packed_grade_make(types[t], v);
+			str = packed_grade_string(packed, &len);
+			ck_assert_ptr_nonnull(str);
+			ck_assert_uint_eq(strlen(str), len);
+			ck_assert_uint_lt(len, GRADE_STRING_SIZE);
+			ck_assert_int_eq(packed_grade_parse(str, ANYTYPE, &parsed), 0);
+			ck_assert_uint_eq(parsed, packed);
+		}
+	}
+}
+END_TEST
+
+START_TEST(test_histogram_count)
+{
+	GradeHistogram *histogram;
+	GradeHistogram *other;
+
+	histogram = grade_histogram_create();
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(VERMTYPE, 5)), 0);
+
+	ck_assert_int_eq(grade_histogram_add(histogram, packed_grade_make(VERMTYPE, 5), 1), 0);
+	ck_assert_int_eq(grade_histogram_add(histogram, packed_grade_make(VERMTYPE, 5), 2), 0);
+	ck_assert_int_eq(grade_histogram_add(histogram, packed_grade_make(YDSTYPE, 255), 1), 0);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(VERMTYPE, 5)), 3);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(YDSTYPE, 255)), 1);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(FONTTYPE, 5)), 0);
+
+	ck_assert_int_ne(grade_histogram_add(histogram, packed_grade_make(ANYTYPE, 5), 1), 0);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(ANYTYPE, 5)), 0);
+
+	other = grade_histogram_create();
+	ck_assert_int_eq(grade_histogram_add(other, packed_grade_make(VERMTYPE, 5), 1), 0);
+	ck_assert_int_eq(grade_histogram_add(other, packed_grade_make(FONTTYPE, 5), 4), 0);
+
+	ck_assert_int_eq(grade_histogram_combine(histogram, other), 0);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(VERMTYPE, 5)), 4);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(FONTTYPE, 5)), 4);
+
+	ck_assert_int_eq(grade_histogram_subtract(histogram, other), 0);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(VERMTYPE, 5)), 3);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(FONTTYPE, 5)), 0);
+
+	// counts don't go negative
+	ck_assert_int_ne(grade_histogram_add(histogram, packed_grade_make(FONTTYPE, 5), -1), 0);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(FONTTYPE, 5)), 0);
+	ck_assert_int_ne(grade_histogram_subtract(histogram, other), 0);
+
+	// or wrap around
+	ck_assert_int_eq(grade_histogram_add(other, packed_grade_make(VERMTYPE, 0), INT64_MAX), 0);
+	ck_assert_int_ne(grade_histogram_add(other, packed_grade_make(VERMTYPE, 0), 1), 0);
+
+	grade_histogram_free(histogram);
+	grade_histogram_free(other);
+}
+END_TEST
+
+START_TEST(test_histogram_buffer)
+{
+	GradeHistogram *histogram;
+	GradeHistogram *read;
+	uint8_t buf[64];
+	size_t size;
+
+	histogram = grade_histogram_create();
+	read = grade_histogram_create();
+
+	// an empty histogram is just the number of entries
+	ck_assert_uint_eq(grade_histogram_buffer_size(histogram), 4);
+
+	grade_histogram_add(histogram, packed_grade_make(VERMTYPE, 5), 3);
+	grade_histogram_add(histogram, packed_grade_make(YDSTYPE, 17), 1);
+	grade_histogram_add(histogram, packed_grade_make(FONTTYPE, 0), INT64_MAX);
+
+	size = grade_histogram_buffer_size(histogram);
+	ck_assert_uint_eq(size, 4 + 3 * 10);
+	ck_assert_uint_eq(grade_histogram_buffer_write(histogram, buf), size);
+
+	ck_assert_int_eq(grade_histogram_from_buffer(read, buf, size), 0);
+	ck_assert_mem_eq(read->counts, histogram->counts, sizeof(histogram->counts));
+
+	// truncated or corrupt buffers are rejected
+	ck_assert_int_ne(grade_histogram_from_buffer(read, buf, size - 1), 0);
+	ck_assert_int_ne(grade_histogram_from_buffer(read, buf, 2), 0);
+	buf[4] = ANYTYPE;
+	ck_assert_int_ne(grade_histogram_from_buffer(read, buf, size), 0);
+
+	grade_histogram_buffer_write(histogram, buf);
+	memcpy(buf + 6, &(int64_t){ -1 }, sizeof(int64_t));
+	ck_assert_int_ne(grade_histogram_from_buffer(read, buf, size), 0);
+
+	grade_histogram_free(histogram);
+	grade_histogram_free(read);
+}
+END_TEST
+
+START_TEST(test_histogram_string)
+{
+	GradeHistogram *histogram;
+	char *str;
+
+	histogram = grade_histogram_create();
+
+	str = grade_histogram_to_string(histogram);
+	ck_assert_str_eq(str, "{}");
+	free(str);
+
+	ck_assert_int_eq(grade_histogram_parse(histogram, "{5.11b:1,V5:2,F7A+:3,V5:1}"), 0);
+	ck_assert_int_eq(grade_histogram_count(histogram, packed_grade_make(VERMTYPE, 5)), 3);
+
+	// grades are written in grade order
+	str = grade_histogram_to_string(histogram);
+	ck_assert_str_eq(str, "{V5:3,F7A+:3,5.11b:1}");
+	free(str);
+
+	ck_assert_int_eq(grade_histogram_parse(histogram, "{F1:9223372036854775807}"), 0);
+	str = grade_histogram_to_string(histogram);
+	ck_assert_str_eq(str, "{F1:9223372036854775807}");
+	free(str);
+
+	ck_assert_int_eq(grade_histogram_parse(histogram, "{}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, ""), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{}x"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{V5}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{V5:}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{V5:1,}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{nope:1}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{V5:9223372036854775808}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{V5:9223372036854775807,V5:1}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{V5:-1}"), 0);
+	ck_assert_int_ne(grade_histogram_parse(histogram, "{V5:2,V5:-1}"), 0);
+
+	grade_histogram_free(histogram);
+}
+END_TEST
+
+START_TEST(test_histogram_percentile)
+{
+	GradeHistogram *histogram;
+	PackedGrade packed;
+
+	histogram = grade_histogram_create();
+	ck_assert_int_ne(grade_histogram_percentile(histogram, 0.5, &packed), 0);
+	ck_assert_int_ne(grade_histogram_mode(histogram, &packed), 0);
+
+	// V3, V7, V7, V7, F6A, 5.10a
+	ck_assert_int_eq(grade_histogram_parse(histogram, "{V3:1,V7:3,F6A:1,5.10a:1}"), 0);
+
+	ck_assert_int_eq(grade_histogram_percentile(histogram, 0, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V3");
+	ck_assert_int_eq(grade_histogram_percentile(histogram, 0.1, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V3");
+	ck_assert_int_eq(grade_histogram_percentile(histogram, 0.5, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V7");
+	ck_assert_int_eq(grade_histogram_percentile(histogram, 0.7, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "F6A");
+	ck_assert_int_eq(grade_histogram_percentile(histogram, 1, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "5.10a");
+
+	ck_assert_int_ne(grade_histogram_percentile(histogram, -0.1, &packed), 0);
+	ck_assert_int_ne(grade_histogram_percentile(histogram, 1.1, &packed), 0);
+
+	ck_assert_int_eq(grade_histogram_mode(histogram, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V7");
+
+	// ties go to the easiest grade
+	ck_assert_int_eq(grade_histogram_parse(histogram, "{F6A:2,V3:2,5.10a:1}"), 0);
+	ck_assert_int_eq(grade_histogram_mode(histogram, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V3");
+
+	grade_histogram_free(histogram);
+}
+END_TEST
+
+START_TEST(test_top_k_add)
+{
+	const char *grades[] = { "V3", "V7", "F6A", "V5", "V10", "V1", "5.10a", "V7" };
+	GradeTopKEntry entries[4];
+	GradeTopK *top;
+	PackedGrade packed;
+
+	ck_assert_ptr_null(grade_top_k_create(0));
+	ck_assert_ptr_null(grade_top_k_create(GRADE_TOP_K_MAX + 1));
+
+	top = grade_top_k_create(4);
+	ck_assert_uint_eq(grade_top_k_sorted(top, entries), 0);
+
+	for (size_t i = 0; i < sizeof(grades) / sizeof(grades[0]); i++) {
+		ck_assert_int_eq(packed_grade_parse(grades[i], ANYTYPE, &packed), 0);
+		grade_top_k_add(top, packed, i);
+	}
+
+	// the hardest four, hardest first
+	ck_assert_uint_eq(grade_top_k_sorted(top, entries), 4);
+	ck_assert_str_eq(packed_grade_string(entries[0].grade, NULL), "5.10a");
+	ck_assert_str_eq(packed_grade_string(entries[1].grade, NULL), "F6A");
+	ck_assert_str_eq(packed_grade_string(entries[2].grade, NULL), "V10");
+	ck_assert_str_eq(packed_grade_string(entries[3].grade, NULL), "V7");
+
+	// of the two V7s, the one with more points was kept
+	ck_assert_double_eq(entries[3].points, 7);
+
+	grade_top_k_free(top);
+}
+END_TEST
+
+START_TEST(test_top_k_combine)
+{
+	GradeTopKEntry entries[3];
+	GradeTopK *top;
+	GradeTopK *other;
+
+	top = grade_top_k_create(3);
+	other = grade_top_k_create(3);
+
+	grade_top_k_add(top, packed_grade_make(VERMTYPE, 4), 1);
+	grade_top_k_add(top, packed_grade_make(VERMTYPE, 8), 2);
+	grade_top_k_add(other, packed_grade_make(VERMTYPE, 6), 3);
+	grade_top_k_add(other, packed_grade_make(VERMTYPE, 9), 4);
+	grade_top_k_add(other, packed_grade_make(VERMTYPE, 2), 5);
+
+	grade_top_k_combine(top, other);
+
+	ck_assert_uint_eq(grade_top_k_sorted(top, entries), 3);
+	ck_assert_uint_eq(entries[0].grade, packed_grade_make(VERMTYPE, 9));
+	ck_assert_uint_eq(entries[1].grade, packed_grade_make(VERMTYPE, 8));
+	ck_assert_uint_eq(entries[2].grade, packed_grade_make(VERMTYPE, 6));
+
+	grade_top_k_free(top);
+	grade_top_k_free(other);
+}
+END_TEST
+
+START_TEST(test_top_k_buffer)
+{
+	GradeTopKEntry entries[3];
+	GradeTopK *top;
+	GradeTopK *read;
+	uint8_t buf[64];
+	size_t size;
+
+	top = grade_top_k_create(3);
+	grade_top_k_add(top, packed_grade_make(FONTTYPE, 17), 1.5);
+	grade_top_k_add(top, packed_grade_make(VERMTYPE, 8), 2);
+
+	size = grade_top_k_buffer_size(top);
+	ck_assert_uint_eq(size, 8 + 2 * 10);
+	ck_assert_uint_eq(grade_top_k_buffer_write(top, buf), size);
+
+	read = grade_top_k_from_buffer(buf, size);
+	ck_assert_ptr_nonnull(read);
+	ck_assert_uint_eq(read->k, 3);
+	ck_assert_uint_eq(grade_top_k_sorted(read, entries), 2);
+	ck_assert_uint_eq(entries[0].grade, packed_grade_make(FONTTYPE, 17));
+	ck_assert_double_eq(entries[0].points, 1.5);
+	ck_assert_uint_eq(entries[1].grade, packed_grade_make(VERMTYPE, 8));
+	grade_top_k_free(read);
+
+	// truncated or corrupt buffers are rejected
+	ck_assert_ptr_null(grade_top_k_from_buffer(buf, size - 1));
+	ck_assert_ptr_null(grade_top_k_from_buffer(buf, 4));
+	buf[8] = ANYTYPE;
+	ck_assert_ptr_null(grade_top_k_from_buffer(buf, size));
+
+	grade_top_k_free(top);
+}
+END_TEST
+
+START_TEST(test_histogram_min_max)
+{
+	GradeHistogram *histogram;
+	PackedGrade packed;
+
+	histogram = grade_histogram_create();
+	ck_assert_int_ne(grade_histogram_min(histogram, &packed), 0);
+	ck_assert_int_ne(grade_histogram_max(histogram, &packed), 0);
+
+	ck_assert_int_eq(grade_histogram_parse(histogram, "{V3:1,V8:2,F6A:1}"), 0);
+	ck_assert_int_eq(grade_histogram_min(histogram, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V3");
+	ck_assert_int_eq(grade_histogram_max(histogram, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "F6A");
+
+	// grades leaving a window frame are subtracted back out
+	ck_assert_int_eq(grade_histogram_add(histogram, packed_grade_make(FONTTYPE, 10), -1), 0);
+	ck_assert_int_eq(grade_histogram_add(histogram, packed_grade_make(VERMTYPE, 3), -1), 0);
+	ck_assert_int_eq(grade_histogram_min(histogram, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V8");
+	ck_assert_int_eq(grade_histogram_max(histogram, &packed), 0);
+	ck_assert_str_eq(packed_grade_string(packed, NULL), "V8");
+
+	grade_histogram_free(histogram);
+}
+END_TEST
+
 static Suite* pg_climb_suite(void)
 {
 	Suite *s;
@@ -654,6 +1306,9 @@ static Suite* pg_climb_suite(void)
 	TCase *tc_font;
 	TCase *tc_yds;
 	TCase *tc_serial;
+	TCase *tc_packed;
+	TCase *tc_histogram;
+	TCase *tc_top_k;
 
 	s = suite_create("pg_climb");
 	tc_core = tcase_create("Core");
@@ -661,12 +1316,16 @@ static Suite* pg_climb_suite(void)
 	tc_font = tcase_create("Font-Scale");
 	tc_yds = tcase_create("Yosemite Decimal System");
 	tc_serial = tcase_create("Serialization");
+	tc_packed = tcase_create("Packing");
+	tc_histogram = tcase_create("Histogram");
+	tc_top_k = tcase_create("Top K");
 
 	tcase_add_test(tc_core, test_grade_type_name);
 	tcase_add_test(tc_core, test_grade_type_from_typmod);
 	tcase_add_test(tc_core, test_grade_strings);
 	tcase_add_test(tc_core, test_grade_cmp);
 	tcase_add_test(tc_core, test_typmod_string);
+	tcase_add_test(tc_core, test_grade_allocator);
 	suite_add_tcase(s, tc_core);
 
 	tcase_add_test(tc_verm, test_verm_basic);
@@ -691,9 +1350,31 @@ static Suite* pg_climb_suite(void)
 	tcase_add_test(tc_serial, test_serial_font);
 	tcase_add_test(tc_serial, test_serial_yds);
 	tcase_add_test(tc_serial, test_serial_grade);
+	tcase_add_test(tc_serial, test_serial_legacy);
 	tcase_add_test(tc_serial, test_serial_cmp);
 	suite_add_tcase(s, tc_serial);
 
+	tcase_add_test(tc_packed, test_packed_grade);
+	tcase_add_test(tc_packed, test_packed_cmp);
+	tcase_add_test(tc_packed, test_packed_next);
+	tcase_add_test(tc_packed, test_packed_buffer);
+	tcase_add_test(tc_packed, test_packed_parse);
+	tcase_add_test(tc_packed, test_packed_string);
+	tcase_add_test(tc_packed, test_packed_convert);
+	suite_add_tcase(s, tc_packed);
+
+	tcase_add_test(tc_histogram, test_histogram_count);
+	tcase_add_test(tc_histogram, test_histogram_buffer);
+	tcase_add_test(tc_histogram, test_histogram_string);
+	tcase_add_test(tc_histogram, test_histogram_percentile);
+	tcase_add_test(tc_histogram, test_histogram_min_max);
+	suite_add_tcase(s, tc_histogram);
+
+	tcase_add_test(tc_top_k, test_top_k_add);
+	tcase_add_test(tc_top_k, test_top_k_combine);
+	tcase_add_test(tc_top_k, test_top_k_buffer);
+	suite_add_tcase(s, tc_top_k);
+
 	return s;
 }
 